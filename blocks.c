@@ -7,8 +7,11 @@
 #include "blocks.h"
 #include "game.h"
 #include "pixel_colour.h"
-#include <stdlib.h>
-/* Stdlib needed for random() - random number generator */
+#include <avr/pgmspace.h>
+
+/* State of the block generator's random number generator */
+static uint32_t random_state = 1;
+static uint32_t next_random(void);
 
 /*
  * Define the block library. 
@@ -21,7 +24,8 @@
 // -------*
 #define BLOCK_0_HEIGHT 1
 #define BLOCK_0_WIDTH 1
-static rowtype block_0[] = { 0b1 };
+#define BLOCK_0_ROWS 0b1
+static rowtype block_0[] = { BLOCK_0_ROWS };
 
 // Block 1 (3 x 1) has two patterns
 // -------* -----***
@@ -29,15 +33,18 @@ static rowtype block_0[] = { 0b1 };
 // -------*
 #define BLOCK_1_HEIGHT 3
 #define BLOCK_1_WIDTH 1
-static rowtype block_1_vert[] = { 0b1, 0b1, 0b1 };
-static rowtype block_1_horiz[] = { 0b111 };
+#define BLOCK_1_VERT_ROWS 0b1, 0b1, 0b1
+#define BLOCK_1_HORIZ_ROWS 0b111
+static rowtype block_1_vert[] = { BLOCK_1_VERT_ROWS };
+static rowtype block_1_horiz[] = { BLOCK_1_HORIZ_ROWS };
 	
 // Block 2 (2 x 2) has only one pattern
 // ------**
 // ------**
 #define BLOCK_2_HEIGHT 2
 #define BLOCK_2_WIDTH 2
-static rowtype block_2[] = { 0b11, 0b11 };
+#define BLOCK_2_ROWS 0b11, 0b11
+static rowtype block_2[] = { BLOCK_2_ROWS };
 	
 // Block 3 (2 x 3) has four patterns
 // ------*- ------*- -----*** -------*
@@ -45,10 +52,14 @@ static rowtype block_2[] = { 0b11, 0b11 };
 //          ------*-          -------*         
 #define BLOCK_3_HEIGHT 2
 #define BLOCK_3_WIDTH 3
-static rowtype block_3_rot_0[] = { 0b010, 0b111 };
-static rowtype block_3_rot_1[] = { 0b10, 0b11, 0b10 };
-static rowtype block_3_rot_2[] = { 0b111, 0b010 };
-static rowtype block_3_rot_3[] = { 0b01, 0b11, 0b01 };
+#define BLOCK_3_ROT_0_ROWS 0b010, 0b111
+#define BLOCK_3_ROT_1_ROWS 0b10, 0b11, 0b10
+#define BLOCK_3_ROT_2_ROWS 0b111, 0b010
+#define BLOCK_3_ROT_3_ROWS 0b01, 0b11, 0b01
+static rowtype block_3_rot_0[] = { BLOCK_3_ROT_0_ROWS };
+static rowtype block_3_rot_1[] = { BLOCK_3_ROT_1_ROWS };
+static rowtype block_3_rot_2[] = { BLOCK_3_ROT_2_ROWS };
+static rowtype block_3_rot_3[] = { BLOCK_3_ROT_3_ROWS };
 
 // Block 4 (2 x 3) has four patterns
 // -------* ------*- -----*** ------**
@@ -56,10 +67,14 @@ static rowtype block_3_rot_3[] = { 0b01, 0b11, 0b01 };
 //          ------**          -------*
 #define BLOCK_4_HEIGHT 2
 #define BLOCK_4_WIDTH 3
-static rowtype block_4_rot_0[] = { 0b001, 0b111 };
-static rowtype block_4_rot_1[] = { 0b10, 0b10, 0b11 };
-static rowtype block_4_rot_2[] = { 0b111, 0b100 };
-static rowtype block_4_rot_3[] = { 0b11, 0b01, 0b01 };
+#define BLOCK_4_ROT_0_ROWS 0b001, 0b111
+#define BLOCK_4_ROT_1_ROWS 0b10, 0b10, 0b11
+#define BLOCK_4_ROT_2_ROWS 0b111, 0b100
+#define BLOCK_4_ROT_3_ROWS 0b11, 0b01, 0b01
+static rowtype block_4_rot_0[] = { BLOCK_4_ROT_0_ROWS };
+static rowtype block_4_rot_1[] = { BLOCK_4_ROT_1_ROWS };
+static rowtype block_4_rot_2[] = { BLOCK_4_ROT_2_ROWS };
+static rowtype block_4_rot_3[] = { BLOCK_4_ROT_3_ROWS };
 	
 static const BlockInfo block_library[NUM_BLOCKS_IN_LIBRARY] = {
 	{ // Block 0
@@ -83,13 +98,62 @@ static const BlockInfo block_library[NUM_BLOCKS_IN_LIBRARY] = {
 		{ block_4_rot_0, block_4_rot_1, block_4_rot_2, block_4_rot_3 }	
 	}
 };
+
+/*
+ * Collision masks. For each block, rotation and column we store the bits
+ * the block occupies in each of its rows when positioned at that column,
+ * i.e. the block pattern shifted left by the column number. These are 
+ * what get ANDed with the board rows to check for collisions. The table
+ * is generated from the patterns above by the ROW_MASKS macro and kept in
+ * program memory. (Masks for columns where the block would be off the 
+ * board are never used.)
+ */
+#define MAX_BLOCK_HEIGHT 3
+#define ROW_MASKS_AT(column, r0, r1, r2) \
+		{ (rowtype)((r0) << (column)), (rowtype)((r1) << (column)), \
+		  (rowtype)((r2) << (column)) }
+#define ROW_MASKS_FOR_ROWS(r0, r1, r2, ...) { \
+		ROW_MASKS_AT(0, r0, r1, r2), ROW_MASKS_AT(1, r0, r1, r2), \
+		ROW_MASKS_AT(2, r0, r1, r2), ROW_MASKS_AT(3, r0, r1, r2), \
+		ROW_MASKS_AT(4, r0, r1, r2), ROW_MASKS_AT(5, r0, r1, r2), \
+		ROW_MASKS_AT(6, r0, r1, r2), ROW_MASKS_AT(7, r0, r1, r2) }
+// Patterns with fewer than MAX_BLOCK_HEIGHT rows are padded with 0s
+#define ROW_MASKS(...) ROW_MASKS_FOR_ROWS(__VA_ARGS__, 0, 0, 0)
+
+static const rowtype block_row_mask_table[NUM_BLOCKS_IN_LIBRARY]
+		[NUM_ROTATIONS][BOARD_WIDTH][MAX_BLOCK_HEIGHT] PROGMEM = {
+	{ // Block 0
+		ROW_MASKS(BLOCK_0_ROWS), ROW_MASKS(BLOCK_0_ROWS),
+		ROW_MASKS(BLOCK_0_ROWS), ROW_MASKS(BLOCK_0_ROWS)
+	},
+	{ // Block 1
+		ROW_MASKS(BLOCK_1_VERT_ROWS), ROW_MASKS(BLOCK_1_HORIZ_ROWS),
+		ROW_MASKS(BLOCK_1_VERT_ROWS), ROW_MASKS(BLOCK_1_HORIZ_ROWS)
+	},
+	{ // Block 2
+		ROW_MASKS(BLOCK_2_ROWS), ROW_MASKS(BLOCK_2_ROWS),
+		ROW_MASKS(BLOCK_2_ROWS), ROW_MASKS(BLOCK_2_ROWS)
+	},
+	{ // Block 3
+		ROW_MASKS(BLOCK_3_ROT_0_ROWS), ROW_MASKS(BLOCK_3_ROT_1_ROWS),
+		ROW_MASKS(BLOCK_3_ROT_2_ROWS), ROW_MASKS(BLOCK_3_ROT_3_ROWS)
+	},
+	{ // Block 4
+		ROW_MASKS(BLOCK_4_ROT_0_ROWS), ROW_MASKS(BLOCK_4_ROT_1_ROWS),
+		ROW_MASKS(BLOCK_4_ROT_2_ROWS), ROW_MASKS(BLOCK_4_ROT_3_ROWS)
+	}
+};
 	
 	
+void init_block_generator(uint32_t seed) {
+	random_state = seed;
+}
+
 FallingBlock generate_random_block(void) {
 	FallingBlock block;	// This will be our return value
 
 	// Pick a random block
-	block.blocknum = random() % NUM_BLOCKS_IN_LIBRARY;
+	block.blocknum = next_random() % NUM_BLOCKS_IN_LIBRARY;
 	
 	// Initial rotation (no rotation by default)
 	block.rotation = 0;	
@@ -110,6 +174,11 @@ FallingBlock generate_random_block(void) {
 	return block;
 }
 
+const rowtype* block_row_masks(const FallingBlock* blockPtr) {
+	return block_row_mask_table[blockPtr->blocknum][blockPtr->rotation]
+			[blockPtr->column];
+}
+
 /*
  * Attempt to rotate the given block clockwise by 90 degrees.
  * Returns 1 if successful (and modifies the given block) otherwise
@@ -177,3 +246,26 @@ int8_t move_block_right(FallingBlock* blockPtr) {
 	 */
 	return 1;
 }
+
+/*
+ * Return the next number (0 to 0x7FFFFFFE) from our random number 
+ * generator. This is the "minimal standard" generator used by random() in
+ * avr-libc (same algorithm, so the same block sequence for a given seed),
+ * but kept here so that games can be replayed exactly on the host where
+ * the C library's random() is different.
+ */
+static uint32_t next_random(void) {
+	int32_t x = random_state;
+	if(x == 0) {
+		// Can't be seeded with 0, so use another value
+		x = 123459876L;
+	}
+	int32_t hi = x / 127773L;
+	int32_t lo = x % 127773L;
+	x = 16807L * lo - 2836L * hi;
+	if(x < 0) {
+		x += 0x7FFFFFFFL;
+	}
+	random_state = x;
+	return x;
+}
@@ -71,12 +71,26 @@ typedef struct {
 	uint8_t height;
 } FallingBlock;
 
+/*
+ * Seed the random number generator used to choose blocks. The same seed
+ * always gives the same sequence of blocks.
+ */
+void init_block_generator(uint32_t seed);
+
 /* 
  * Randomly choose a block from the block library and position
  * it at the top of the board.
  */
 FallingBlock generate_random_block(void);
 
+/*
+ * Return the bits the given block occupies in each of its rows at its
+ * current column and rotation (i.e. the pattern shifted left by the column
+ * number). The returned pointer is to program memory - the rows must be
+ * read with pgm_read_byte().
+ */
+const rowtype* block_row_masks(const FallingBlock* blockPtr);
+
 /*
  * Attempt to rotate the given block clockwise by 90 degrees.
  * Returns 1 if successful (and modifies the given block) otherwise
@@ -2,107 +2,112 @@
  * buttons.c
  *
  * Author: Peter Sutton
+ *
+ * The buttons are sampled every millisecond from the timer 0 interrupt
+ * handler (see sample_buttons()). Each button has an integrating debouncer:
+ * a count which goes up (to DEBOUNCE_SAMPLES) for each sample in which the
+ * pin is high and down (to 0) for each sample in which it is low. The 
+ * button is considered pushed when the count reaches DEBOUNCE_SAMPLES and
+ * released when it gets back to 0, so switch bounce shorter than this 
+ * doesn't produce extra button pushes. A button can also be set to repeat
+ * while held: after the delay (DAS - delayed auto shift) the push is 
+ * repeated at the auto repeat rate (ARR) until the button is released.
+ * Button pushes are added to the input queue (see input_queue.h).
  */ 
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include "buttons.h"
+#include "timer0.h"
+#include "input_queue.h"
+
+#define NUM_BUTTONS 4
+
+// Number of consecutive samples (milliseconds) a pin must be high for a
+// button push to be recognised (or low for a release)
+#define DEBOUNCE_SAMPLES 5
 
-// Global variable to keep track of the last button state so that we 
-// can detect changes when an interrupt fires. The lower 4 bits (0 to 3)
-// will correspond to the last state of port B pins 0 to 3.
-static volatile uint8_t last_button_state;
+// Debounced state of the buttons - bits 0 to 3 are 1 when buttons 0 to 3
+// are pushed. Only changed by sample_buttons().
+static volatile uint8_t button_state;
+static uint8_t debounce_count[NUM_BUTTONS];
+
+// Autorepeat settings (in milliseconds, 0 delay means no repeat) and the 
+// time left until the next repeat for each button
+static volatile uint16_t repeat_delay[NUM_BUTTONS];
+static volatile uint16_t repeat_interval[NUM_BUTTONS];
+static uint16_t repeat_countdown[NUM_BUTTONS];
 
-// Our button queue. button_queue[0] is always the head of the queue. If we
-// take something off the queue we just move everything else along. We don't
-// use a circular buffer since it is usually expected that the queue is very
-// short. In most uses it will never have more than 1 element at a time.
-// This button queue can be changed by the interrupt handler below so we should
-// turn off interrupts if we're changing the queue outside the handler.
-#define BUTTON_QUEUE_SIZE 8
-static volatile uint8_t button_queue[BUTTON_QUEUE_SIZE];
-static volatile int8_t queue_length;
 
-// Setup interrupt if any of pins B0 to B3 change. We do this
-// using a pin change interrupt. These pins correspond to pin
-// change interrupts PCINT8 to PCINT11 which are covered by
-// Pin change interrupt 1.
 void init_button_interrupts(void) {
-	// Enable the interrupt (see datasheet page 69)
-	PCICR |= (1<<PCIE1);
-	
-	// Make sure the interrupt flag is cleared (by writing a 
-	// 1 to it) (see datasheet page 69)
-	PCIFR |= (1<<PCIF1);
-	
-	// Choose which pins we're interested in by setting
-	// the relevant bits in the mask register (see datasheet page 70)
-	PCMSK1 |= (1<<PCINT8)|(1<<PCINT9)|(1<<PCINT10)|(1<<PCINT11);	
+	// Pins B0 to B3 are inputs
+	DDRB &= ~0x0F;
 	
-	// Empty the button push queue
-	queue_length = 0;
+	// All buttons start released with no autorepeat
+	button_state = 0;
+	for(uint8_t button = 0; button < NUM_BUTTONS; button++) {
+		debounce_count[button] = 0;
+		repeat_delay[button] = 0;
+		repeat_interval[button] = 0;
+	}
 }
 
-void empty_button_queue(void) {
-	queue_length = 0;
+void set_button_repeat(uint8_t button, uint16_t delay, uint16_t interval) {
+	if(button >= NUM_BUTTONS) {
+		return;
+	}
+	// The settings are two bytes each so we make sure the interrupt
+	// handler doesn't see them half changed
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	repeat_delay[button] = delay;
+	repeat_interval[button] = interval;
+	// If the button is already held, the first repeat comes delay
+	// milliseconds from now (rather than the countdown wrapping round)
+	repeat_countdown[button] = delay;
+	if(interrupts_were_on) {
+		sei();
+	}
 }
 
-int8_t button_pushed(void) {
-	int8_t return_value = -1;	// Assume no button pushed
-	if(queue_length > 0) {
-		// Remove the first element off the queue and move all the other
-		// entries closer to the front of the queue. We turn off interrupts (if on)
-		// before we make any changes to the queue. If interrupts were on
-		// we turn them back on when done.
-		return_value = button_queue[0];
-		
-		// Save whether interrupts were enabled and turn them off
-		int8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
-		cli();
+uint8_t buttons_held(void) {
+	return button_state;
+}
+
+void sample_buttons(void) {
+	uint8_t pins = PINB & 0x0F;
+	uint32_t time = get_clock_ticks();
+	
+	for(uint8_t button = 0; button < NUM_BUTTONS; button++) {
+		uint8_t button_bit = (1 << button);
 		
-		for(uint8_t i = 1; i < queue_length; i++) {
-			button_queue[i-1] = button_queue[i];
+		// Integrate the pin samples
+		if(pins & button_bit) {
+			if(debounce_count[button] < DEBOUNCE_SAMPLES) {
+				debounce_count[button]++;
+			}
+		} else if(debounce_count[button] > 0) {
+			debounce_count[button]--;
 		}
-		queue_length--;
 		
-		if(interrupts_were_enabled) {
-			// Turn them back on again
-			sei();
-		}
-	}
-	return return_value;
-}
-
-// Interrupt handler for a change on buttons
-ISR(PCINT1_vect) {
-	// Get the current state of the buttons. We'll compare this with
-	// the last state to see what has changed.
-	uint8_t button_state = PINB & 0x0F;
-
-	// If we have space in the queue, then iterate over all the buttons
-	// and see which ones have changed.	If we have no space in the queue
-	// we don't bother - we just ignore the button event.  (Ideally
-	// this should never happen.)
-	if(queue_length < BUTTON_QUEUE_SIZE) {
-		// Iterate over all the buttons and see which ones have changed.
-		// Any button pushes are added to the queue of button pushes (if
-		// there is space). We ignore button releases so we're just looking
-		// for a transition from 0 in the last_button_state bit to a 1 in the
-		// button_state.
-		for(uint8_t pin=0; pin<=3; pin++) {
-			if((button_state & (1<<pin)) &&	!(last_button_state & (1<<pin))) {
-				// Add the button push to the queue (and update the
-				// length of the queue). If the queue is now full, we stop
-				// processing (i.e. ignore other button events if there
-				// are any)
-				button_queue[queue_length++] = pin;
-				if(queue_length >= BUTTON_QUEUE_SIZE) {
-					break;
-				}
+		if(!(button_state & button_bit)) {
+			if(debounce_count[button] == DEBOUNCE_SAMPLES) {
+				// Button has been pushed
+				button_state |= button_bit;
+				queue_input(INPUT_BUTTON, button, time);
+				repeat_countdown[button] = repeat_delay[button];
+			}
+		} else if(debounce_count[button] == 0) {
+			// Button has been released
+			button_state &= ~button_bit;
+		} else if(repeat_delay[button] != 0 && --repeat_countdown[button] == 0) {
+			// Button is being held and it's time to repeat
+			queue_input(INPUT_BUTTON, button, time);
+			repeat_countdown[button] = repeat_interval[button];
+			if(repeat_countdown[button] == 0) {
+				// No repeat interval - repeat every sample
+				repeat_countdown[button] = 1;
 			}
 		}
 	}
-		
-	// Remember this button state so we can detect changes next time
-	last_button_state = button_state;
 }
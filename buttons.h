@@ -3,8 +3,9 @@
  *
  * Author: Peter Sutton
  *
- * We assume four push buttons (B0 to B3) are connected to pins B0 to B3. We configure
- * pin change interrupts on these pins.
+ * We assume four push buttons (B0 to B3) are connected to pins B0 to B3. These
+ * pins are sampled (and debounced) every millisecond by the timer 0 interrupt 
+ * handler, which calls sample_buttons().
  */ 
 
 
@@ -13,24 +14,29 @@
 
 #include <stdint.h>
 
-/* Set up pin change interrupts on pins B0 to B3.
+/* Set up pins B0 to B3 as button inputs. No buttons will autorepeat.
  * It is assumed that global interrupts are off when this function is called
  * and are enabled sometime after this function is called.
  */
 void init_button_interrupts(void);
 
-/* Empty the button press queue
+/* Set the given button (0 to 3) to repeat while it is held down. The first
+ * repeat happens delay milliseconds after the button is pushed, then it
+ * repeats every interval milliseconds. A delay of 0 turns off autorepeat 
+ * for the button.
  */
-void empty_button_queue(void);
+void set_button_repeat(uint8_t button, uint16_t delay, uint16_t interval);
 
-/* Return the last button pushed (0 to 3) or -1 if there are no
- * button pushes to return. (A small queue of button pushes is
- * kept. This function should be called frequently enough to
- * ensure the queue does not overflow. Excess button pushes are
- * discarded.)
+/* Return the buttons currently held down (after debouncing) - bit n is
+ * set if button n is held.
  */
+uint8_t buttons_held(void);
 
-int8_t button_pushed(void);
-
+/* Sample the buttons, adding any (debounced) button pushes and repeats to
+ * the input queue (see input_queue.h) with source INPUT_BUTTON and the 
+ * button number (0 to 3) as the code. Must be called every millisecond
+ * (from the timer interrupt handler).
+ */
+void sample_buttons(void);
 
 #endif /* BUTTONS_H_ */
\ No newline at end of file
@@ -14,10 +14,9 @@
 #include "blocks.h"
 #include "score.h"
 #include "ledmatrix.h"
-#include "terminalio.h" // TODO: REMOVE
+#include "terminal_board.h"
+#include "sound.h"
 #include <avr/pgmspace.h>
-#define F_CPU 8000000L
-#include <util/delay.h>
 #include <stdio.h>
 
 /*
@@ -34,9 +33,13 @@
  */
 static void check_for_completed_rows(void);
 static uint8_t add_random_block(void);
-static uint8_t block_collides(FallingBlock block);
+static uint8_t block_collides(const FallingBlock* block);
 static void remove_current_block_from_board_display(void);
 static void add_current_block_to_board_display(void);
+static uint8_t find_landing_row(void);
+static void update_column_tops(void);
+static uint8_t palette_index(PixelColour colour);
+static void expand_display_row(uint8_t row, MatrixColumn col);
 
 /*
  * Global variables.
@@ -44,19 +47,39 @@ static void add_current_block_to_board_display(void);
  *	- an array of "rowtype" rows (which has one bit per column
  *    which indicates whether the given position is occupied or not). This 
  *    representation does NOT include the current dropping block.
- *  - an array of corresponding LED matrix columns (a row of the game
- *    will be displayed on a column). This records colour information
- *    for each position. This DOES include the current dropping block.
+ *  - an array of rows of colour information for each position (a row
+ *    of the game will be displayed on a column of the LED matrix). This
+ *    DOES include the current dropping block. To save space each colour
+ *    is stored as a 3 bit index into board_palette. The index bits are
+ *    held in three bit planes per row - bit c of plane i is bit i of the
+ *    colour index of column c. Rows are only expanded to LED matrix
+ *    columns when they are displayed (see expand_display_row()).
  * For both representations, the array is indexed from row 0.
- * For "board" - column 0 (bit 0) is on the right
- * For "board_display" - element 0 within each MatrixColumn is on the left
+ * For both "board" and the "board_display" bit planes - column 0 (bit 0)
+ * is on the right. (Element 0 within a MatrixColumn is on the left.)
  */
+#define PALETTE_BITS 3
+typedef rowtype PackedColourRow[PALETTE_BITS];
+
+static const PixelColour board_palette[1 << PALETTE_BITS] PROGMEM = {
+	COLOUR_BLACK, COLOUR_RED, COLOUR_GREEN, COLOUR_YELLOW, COLOUR_ORANGE,
+	COLOUR_LIGHT_ORANGE, COLOUR_LIGHT_YELLOW, COLOUR_LIGHT_GREEN
+};
+
 rowtype    board[BOARD_ROWS];
-MatrixColumn board_display[BOARD_ROWS];
+PackedColourRow board_display[BOARD_ROWS];
 FallingBlock current_block;	// Current dropping block - there will 
 							// always be one if the game is being played
 FallingBlock next_block;
 
+/*
+ * Height map of the fixed blocks on the board. column_top[c] is the
+ * topmost occupied row in column c of the board (column 0 on the right),
+ * or BOARD_ROWS if the column is empty. This is kept up to date when blocks
+ * are fixed to the board and when rows are removed.
+ */
+static uint8_t column_top[BOARD_WIDTH];
+
 /* 
  * Initialise board - all the row data will be empty (0) and we
  * create an initial random block and add it to the top of the board.
@@ -67,10 +90,13 @@ void init_game(void) {
 
 	for(uint8_t row=0; row < BOARD_ROWS; row++) {
 		board[row] = 0;
-		for(uint8_t col=0; col < MATRIX_NUM_ROWS; col++) {
-			board_display[row][col] = 0;
+		for(uint8_t plane=0; plane < PALETTE_BITS; plane++) {
+			board_display[row][plane] = 0;
 		}
 	}
+	for(uint8_t col=0; col < BOARD_WIDTH; col++) {
+		column_top[col] = BOARD_ROWS;
+	}
 	// Adding a random block will update the "current_block" and 
 	// add it to the board.	With an empty board this will always
 	// succeed so we ignore the return value - this is indicated 
@@ -83,14 +109,28 @@ void init_game(void) {
 /* 
  * Copy board to LED display for the rows given.
  * Note that each "row" in the board corresponds to a column for
- * the LED matrix.
+ * the LED matrix. Only the pixels which have changed are sent to
+ * the LED matrix (if enough rows have changed we let ledmatrix_sync_all()
+ * decide whether to send the whole display at once - it expands the rows
+ * one at a time). The rows are only marked as changed on the terminal - 
+ * they are sent to it when there is room (see terminal_board_flush()).
  */
 void update_rows_on_display(uint8_t row_start, uint8_t num_rows) {
-	uint8_t row_end = row_start + num_rows - 1;
-	for(uint8_t row_num = row_start; row_num <= row_end; row_num++) {
-		ledmatrix_update_column(row_num, board_display[row_num]);
-		terminal_update_column(row_num, board_display[row_num]);
+	if(num_rows >= MATRIX_SYNC_ALL_COLUMNS) {
+		ledmatrix_sync_all(get_display_row);
+	} else {
+		uint8_t row_end = row_start + num_rows - 1;
+		MatrixColumn col;
+		for(uint8_t row_num = row_start; row_num <= row_end; row_num++) {
+			expand_display_row(row_num, col);
+			ledmatrix_sync_column(row_num, col);
+		}
 	}
+	terminal_mark_rows(row_start, num_rows);
+}
+
+void get_display_row(uint8_t row, MatrixColumn col) {
+	expand_display_row(row, col);
 }
 
 /*
@@ -121,7 +161,7 @@ uint8_t attempt_move(int8_t direction) {
 	
 	// The temporary block wasn't at the edge and has been moved
 	// Now check whether it collides with any blocks on the board.
-	if(block_collides(tmp_block)) {
+	if(block_collides(&tmp_block)) {
 		// Block will collide with other blocks so the move can't be
 		// made.
 		return 0;
@@ -160,7 +200,7 @@ uint8_t attempt_drop_block_one_row(void) {
 	 */
 	FallingBlock tmp_block = current_block;
 	tmp_block.row += 1;
-	if(block_collides(tmp_block)) {
+	if(block_collides(&tmp_block)) {
 		// Block will collide if moved down - so we can't move it
 		return 0;
 	}
@@ -178,6 +218,35 @@ uint8_t attempt_drop_block_one_row(void) {
 	return 1;
 }
 
+/*
+ * Drop the current block as far as it will go. The landing row is
+ * worked out directly (see find_landing_row()) rather than by dropping
+ * one row at a time, and the display is updated once. Returns 1 if the 
+ * block moved, 0 if it couldn't move.
+ */
+uint8_t attempt_hard_drop(void) {
+	uint8_t landing_row = find_landing_row();
+	uint8_t start_row = current_block.row;
+	if(landing_row == start_row) {
+		return 0;
+	}
+	
+	remove_current_block_from_board_display();
+	current_block.row = landing_row;
+	add_current_block_to_board_display();
+	
+	// Update the rows the block was in and the rows it is now in (these
+	// may overlap)
+	if(landing_row < start_row + current_block.height) {
+		update_rows_on_display(start_row, 
+				landing_row - start_row + current_block.height);
+	} else {
+		update_rows_on_display(start_row, current_block.height);
+		update_rows_on_display(landing_row, current_block.height);
+	}
+	return 1;
+}
+
 /*
  * Attempt to rotate the block clockwise 90 degrees. Returns 1 if the
  * rotation is successful, 0 otherwise (e.g. a block on the board
@@ -197,7 +266,7 @@ uint8_t attempt_rotation(void) {
 	
 	// The temporary block has been rotated. 
 	// Now check whether it collides with any blocks on the board.
-	if(block_collides(tmp_block)) {
+	if(block_collides(&tmp_block)) {
 		// Block will collide with other blocks so the rotate can't be
 		// made.
 		return 0;
@@ -234,15 +303,20 @@ uint8_t attempt_rotation(void) {
 uint8_t fix_block_to_board_and_add_new_block(void) {
 	
 	add_to_score(1);
+	terminal_mark_score();
 	
-	// clear_terminal();
-	move_cursor(3, 3);
-	printf_P(PSTR("Score: %6d"), get_score());
-	
+	const rowtype* row_masks = block_row_masks(&current_block);
 	for(uint8_t row = 0; row < current_block.height; row++) {
 		uint8_t board_row = current_block.row + row;
-		board[board_row] |= 
-				(current_block.pattern[row]	<< current_block.column);
+		rowtype row_mask = pgm_read_byte(&row_masks[row]);
+		board[board_row] |= row_mask;
+		
+		// Update the height map for the columns this row occupies
+		for(uint8_t col = 0; col < BOARD_WIDTH; col++) {
+			if((row_mask & (1 << col)) && board_row < column_top[col]) {
+				column_top[col] = board_row;
+			}
+		}
 	}
 	make_sound_low();
 	make_sound_low();
@@ -250,122 +324,54 @@ uint8_t fix_block_to_board_and_add_new_block(void) {
 	return add_random_block();
 }
 
-void print_square(uint8_t pixel_color) {
-
-	if (pixel_color == COLOUR_BLACK) {
-		printf_P(PSTR(" "));
-	}
-	else {
-		uint8_t terminal_color = FG_RED;
-
-		if (pixel_color == COLOUR_RED) {
-			terminal_color = FG_RED;
-		}
-		else if (pixel_color == COLOUR_GREEN) {
-			terminal_color = FG_GREEN;
-		}
-		else if (pixel_color == COLOUR_YELLOW) {
-			terminal_color = FG_YELLOW;
-		}
-		else if (pixel_color == COLOUR_ORANGE) {
-			terminal_color = FG_BLUE;
-		}
-		else if (pixel_color == COLOUR_LIGHT_ORANGE) {
-			terminal_color = FG_CYAN;
-		}
-	
-		set_display_attribute(terminal_color);
-		reverse_video();
-		printf_P(PSTR(" "));
-		normal_display_mode();
-	}
-}
-
-
-void print_block_preview(void) {
-	
-	for(uint8_t offset=0; offset < 3; offset++) {
-		move_cursor(15, 15 + offset);
-		print_square(COLOUR_BLACK);
-		print_square(COLOUR_BLACK);
-		print_square(COLOUR_BLACK);
-	}
-		
-	for(uint8_t row=0; row < next_block.height; row++) {
-		move_cursor(15, 15 + row);
-		hide_cursor();
-		uint8_t color = next_block.colour;
-		switch(next_block.pattern[row]) {
-			case 0b001:
-				print_square(COLOUR_BLACK);
-				print_square(COLOUR_BLACK);
-				print_square(color);
-				break;
-			case 0b010:
-				print_square(COLOUR_BLACK);
-				print_square(color);
-				print_square(COLOUR_BLACK);
-				break;
-			case 0b011:
-				print_square(COLOUR_BLACK);
-				print_square(color);
-				print_square(color);
-				break;
-			case 0b111:
-				print_square(color);
-				print_square(color);
-				print_square(color);
-				break;	
-		}
-	}	
-}
-
-void terminal_update_column(uint8_t x, MatrixColumn col) {
-
-	// Repurposing ledmatrix_update_column
-	move_cursor(30, 5 + x);
-	for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
-		print_square(col[y]);
+uint8_t perform_game_action(uint8_t action) {
+	switch(action) {
+		case ACTION_MOVE_LEFT:
+			(void)attempt_move(MOVE_LEFT);
+			break;
+		case ACTION_MOVE_RIGHT:
+			(void)attempt_move(MOVE_RIGHT);
+			break;
+		case ACTION_ROTATE:
+			(void)attempt_rotation();
+			break;
+		case ACTION_DROP:
+			if(!attempt_drop_block_one_row()) {
+				// Drop failed - fix block to board and add new block
+				return fix_block_to_board_and_add_new_block();
+			}
+			break;
+		case ACTION_HARD_DROP:
+			// Drop as far as possible then fix block to board and add 
+			// new block
+			(void)attempt_hard_drop();
+			return fix_block_to_board_and_add_new_block();
 	}
+	return 1;
 }
 
-// These are split across three separate functions
-// because _delay_ms must be known at compile time
-// and cannot be a function parameter
-
-void make_sound_high() {
-	if (PIND & 0b01000000) { // Pin 6 for the mute button
-		for (uint8_t length=0; length < 36; length++) {
-			PORTD ^= 0b10000000;
-			_delay_us(500);
-			PORTD ^= 0b10000000;
-			_delay_us(6);
-		}
+/*
+ * We use the 32 bit FNV-1a hash of the board rows followed by the
+ * colours of each row (as displayed, left to right).
+ */
+uint32_t get_board_hash(void) {
+	uint32_t hash = 2166136261UL;
+	for(uint8_t row = 0; row < BOARD_ROWS; row++) {
+		hash = (hash ^ board[row]) * 16777619UL;
 	}
- }
-
-void make_sound_medium() {
-	if (PIND & 0b01000000) { // Pin 6 for the mute button
-		for (uint8_t length=0; length < 12; length++) {
-			PORTD ^= 0b10000000;
-			_delay_us(1500);
-			PORTD ^= 0b10000000;
-			_delay_us(1500);
+	MatrixColumn col;
+	for(uint8_t row = 0; row < BOARD_ROWS; row++) {
+		expand_display_row(row, col);
+		for(uint8_t i = 0; i < MATRIX_NUM_ROWS; i++) {
+			hash = (hash ^ col[i]) * 16777619UL;
 		}
 	}
+	return hash;
 }
 
-void make_sound_low() {
-	if (PIND & 0b01000000) { // Pin 6 for the mute button
-		for (uint8_t length=0; length < 6; length++) {
-			PORTD ^= 0b10000000;
-			_delay_us(3000);
-			PORTD ^= 0b10000000;
-			_delay_us(3000);
-		}
-	}
+const FallingBlock* get_next_block(void) {
+	return &next_block;
 }
- 
 
 //////////////////////////////////////////////////////////////////////////
 // Internal functions below
@@ -376,76 +382,72 @@ void make_sound_low() {
  * board_display representations are updated. If any rows are complete and 
  * removed then we update the LED matrix. (Each row on the board corresponds
  * to a column on the LED matrix.)
+ *
+ * This is done in a single pass from the bottom of the board up. Each row
+ * which is not complete is copied down to the lowest free position, so
+ * every row moves at most once however many rows are removed. For example,
+ * if rows 11 and 13 are complete then
+ * rows 14 and 15 at the bottom will remain unchanged
+ * old row 12 becomes row 13
+ * old row 10 becomes row 12
+ * ...
+ * old row 0 becomes row 2
+ * rows 0 and 1 at the top are set to 0 (black)
+ * Only rows 0 to 13 (the lowest completed row) need to be redrawn.
  */
 static void check_for_completed_rows(void) {
-
-		for(uint8_t row=0; row < BOARD_ROWS; row++) {
-			if(board[row] == ((1 << BOARD_WIDTH) - 1)) {
-
-				// Found filled row
-				add_to_score(100);
-				increment_cleared_rows();
-				
-				// clear_terminal();
-				move_cursor(3, 3);
-				printf_P(PSTR("Score: %6d"), get_score());
-				
-				// TODO: REMOVE
-				move_cursor(3, 6);
-				printf_P(PSTR("Cleared rows: %6d"), get_cleared_rows());
-				
-				// Shift all rows down up until filled row
-				for(uint8_t i=row; i >= 1; i--) {
-					
-					board[i] = board[i - 1];
-					for(uint8_t j=0; j < MATRIX_NUM_ROWS; j++) {
-						board_display[i][j] = board_display[i - 1][j];
-					}
-				}
-				
-				// Empty the top row
-				board[0] = 0;
-				for(uint8_t j=0; j < MATRIX_NUM_ROWS; j++) {
-					board_display[0][j] = 0;
-				}
-				
-				make_sound_low();
-				make_sound_medium();
-				make_sound_high();
-				make_sound_medium();
-				
-				update_rows_on_display(0, BOARD_ROWS);
+	uint8_t completed_rows = 0;
+	uint8_t lowest_completed_row = 0;
 	
+	// dest_row is the row the next incomplete row will be moved to
+	uint8_t dest_row = BOARD_ROWS;
+	for(uint8_t row = BOARD_ROWS; row > 0; row--) {
+		uint8_t source_row = row - 1;
+		if(board[source_row] == ((1 << BOARD_WIDTH) - 1)) {
+			// Found filled row - it will be overwritten
+			if(completed_rows == 0) {
+				lowest_completed_row = source_row;
+			}
+			completed_rows++;
+		} else {
+			dest_row--;
+			if(dest_row != source_row) {
+				board[dest_row] = board[source_row];
+				for(uint8_t plane = 0; plane < PALETTE_BITS; plane++) {
+					board_display[dest_row][plane] = 
+							board_display[source_row][plane];
+				}
 			}
 		}
-	/* Suggested approach is to iterate over all the rows (0 to
-	 * BOARD_ROWS -1) in the board and check if the row is all ones
-	 * i.e. matches ((1 << BOARD_WIDTH) - 1).
-	 * If a row of all ones is found, the rows above the current
-	 * one should all be moved down one position and a zero (black)
-	 * row inserted at the top. 
-	 * Repeat this process if more than one completed row is
-	 * found. If any completed rows ar found and removed then the 
-	 * relevant rows of the display must also be updated.
-	 *
-	 * Note that both representations of the board must be updated:
-	 * - board - which is the bitmap representation
-	 * - board_display - which has the colours for each position in the row
-	 * (You may find functions in ledmatrix.h useful for manipulating
-	 * an LED matrix column structure - which corresponds to a row in the game.)
-	 *
-	 * EXAMPLE OF MOVES REQUIRED
-	 * If rows 11 and 13 are completed (all ones in the
-	 * board representation), then
-	 * rows 14 and 15 at the bottom will remain unchanged
-	 * old row 12 becomes row 13
-	 * old row 10 becomes row 12
-	 * old row 9 becomes row 11
-	 * ...
-	 * old row 0 becomes row 2
-	 * row 1 (second top row) is set to 0 (black)
-	 * row 0 (top row) is set to 0 (black)
-	 */
+	}
+	
+	if(completed_rows == 0) {
+		return;
+	}
+	
+	// Empty the rows at the top which have been moved down
+	for(uint8_t row = 0; row < dest_row; row++) {
+		board[row] = 0;
+		for(uint8_t plane = 0; plane < PALETTE_BITS; plane++) {
+			board_display[row][plane] = 0;
+		}
+	}
+	update_column_tops();
+	
+	for(uint8_t i = 0; i < completed_rows; i++) {
+		add_to_score(100);
+		increment_cleared_rows();
+	}
+	
+	terminal_mark_score();
+	
+	make_sound_low();
+	make_sound_medium();
+	make_sound_high();
+	make_sound_medium();
+	
+	// Rows below the lowest completed row haven't changed
+	update_rows_on_display(0, lowest_completed_row + 1);
 }
 
 /*
@@ -456,9 +458,9 @@ static uint8_t add_random_block(void) {
 	
 	current_block = next_block;
 	next_block = generate_random_block();
-	print_block_preview();
+	terminal_mark_preview();
 	// Check if the block will collide with the fixed blocks on the board
-	if(block_collides(current_block)) {
+	if(block_collides(&current_block)) {
 		/* Block will collide. We don't add the block - just return 0 - 
 		 * the game is over.
 		 */
@@ -483,15 +485,16 @@ static uint8_t add_random_block(void) {
  * the fixed blocks on the board. Return 1 if it does collide, 0
  * otherwise.
  */
-static uint8_t block_collides(FallingBlock block) {
-	// We work out the bit patterns for the block in each row
+static uint8_t block_collides(const FallingBlock* block) {
+	// We look up the bit patterns for the block in each row
 	// and use a bitwise AND to determine whether there is an
 	// intersection or not
-	for(uint8_t row = 0; row < block.height; row++) {
-		rowtype bit_pattern_for_row = block.pattern[row] << block.column;
-		// The bit pattern to check this against will be that on the board
-		// at the position where the block is located
-		if(bit_pattern_for_row & board[block.row + row]) {
+	const rowtype* row_masks = block_row_masks(block);
+	// The bit patterns to check these against will be those on the board
+	// at the position where the block is located
+	const rowtype* board_rows = &board[block->row];
+	for(uint8_t row = 0; row < block->height; row++) {
+		if(pgm_read_byte(&row_masks[row]) & board_rows[row]) {
 			// This row collides - we can stop now
 			return 1;
 		}
@@ -500,36 +503,121 @@ static uint8_t block_collides(FallingBlock block) {
 }
 
 /*
- * Remove the current block from the display structure
+ * Remove the current block from the display structure, i.e. set the 
+ * colour index of each position it occupies to 0 (black) in each bit plane
  */
 static void remove_current_block_from_board_display(void) {
+	const rowtype* row_masks = block_row_masks(&current_block);
 	for(uint8_t row = 0; row < current_block.height; row++) {
-		uint8_t board_row = row + current_block.row;
-		for(uint8_t col = 0; col < current_block.width; col++) {
-			if(current_block.pattern[row] & (1 << col)) {
-				// This position in the block is occupied - zero it out
-				// in the display
-				uint8_t board_column = col + current_block.column;
-				uint8_t display_column = BOARD_WIDTH - board_column - 1;
-				board_display[board_row][display_column] = 0;
-			}
+		rowtype row_mask = pgm_read_byte(&row_masks[row]);
+		for(uint8_t plane = 0; plane < PALETTE_BITS; plane++) {
+			board_display[current_block.row + row][plane] &= ~row_mask;
 		}
 	}
 }
 
 /*
- * Add the current block to the display structure
+ * Add the current block to the display structure, i.e. set the colour
+ * index of each position it occupies to that of the block's colour
  */
 static void add_current_block_to_board_display(void) {
+	uint8_t colour_index = palette_index(current_block.colour);
+	const rowtype* row_masks = block_row_masks(&current_block);
 	for(uint8_t row = 0; row < current_block.height; row++) {
-		uint8_t board_row = row + current_block.row;
-		for(uint8_t col = 0; col < current_block.width; col++) {
-			if(current_block.pattern[row] & (1 << col)) {
-				// This position in the block is occupied - add it to
-				// the board display 
-				uint8_t board_column = col + current_block.column;
-				uint8_t display_column = BOARD_WIDTH - board_column - 1;
-				board_display[board_row][display_column] = current_block.colour;
+		rowtype row_mask = pgm_read_byte(&row_masks[row]);
+		for(uint8_t plane = 0; plane < PALETTE_BITS; plane++) {
+			if(colour_index & (1 << plane)) {
+				board_display[current_block.row + row][plane] |= row_mask;
+			} else {
+				board_display[current_block.row + row][plane] &= ~row_mask;
+			}
+		}
+	}
+}
+
+/*
+ * Return the index of the given colour in board_palette. (Colours not 
+ * in the palette are shown as red.)
+ */
+static uint8_t palette_index(PixelColour colour) {
+	for(uint8_t index = 1; index < (1 << PALETTE_BITS); index++) {
+		if(pgm_read_byte(&board_palette[index]) == colour) {
+			return index;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Expand the given row of board_display to the colours to be displayed.
+ * Element 0 of the column (the left of the board) is board column 
+ * BOARD_WIDTH - 1.
+ */
+static void expand_display_row(uint8_t row, MatrixColumn col) {
+	rowtype* planes = board_display[row];
+	for(uint8_t i = 0; i < BOARD_WIDTH; i++) {
+		uint8_t board_column = BOARD_WIDTH - i - 1;
+		uint8_t colour_index = 0;
+		for(uint8_t plane = 0; plane < PALETTE_BITS; plane++) {
+			if(planes[plane] & (1 << board_column)) {
+				colour_index |= (1 << plane);
+			}
+		}
+		col[i] = pgm_read_byte(&board_palette[colour_index]);
+	}
+}
+
+/*
+ * Return the row the current block would land on if dropped as far as
+ * possible. If the block is above the fixed blocks in every column it
+ * occupies (the usual case) this is worked out from the height map: in
+ * each column the bottom square of the block can drop to just above the
+ * top of that column. If the block has been moved underneath an overhang
+ * the height map doesn't apply, so we check each row in turn.
+ */
+static uint8_t find_landing_row(void) {
+	uint8_t landing_row = BOARD_ROWS - current_block.height;
+	const rowtype* row_masks = block_row_masks(&current_block);
+	uint8_t last_column = current_block.column + current_block.width;
+	for(uint8_t col = current_block.column; col < last_column; col++) {
+		// Find the bottom row of the block in this column
+		uint8_t bottom = 0;
+		for(uint8_t row = 0; row < current_block.height; row++) {
+			if(pgm_read_byte(&row_masks[row]) & (1 << col)) {
+				bottom = row;
+			}
+		}
+		if(current_block.row + bottom >= column_top[col]) {
+			// Block is below the top of this column - fall back to
+			// checking each row
+			FallingBlock tmp_block = current_block;
+			while(tmp_block.row + tmp_block.height < BOARD_ROWS) {
+				tmp_block.row++;
+				if(block_collides(&tmp_block)) {
+					return tmp_block.row - 1;
+				}
+			}
+			return tmp_block.row;
+		}
+		if(column_top[col] - 1 - bottom < landing_row) {
+			landing_row = column_top[col] - 1 - bottom;
+		}
+	}
+	return landing_row;
+}
+
+/*
+ * Recalculate the height map from the board (after rows have been
+ * removed).
+ */
+static void update_column_tops(void) {
+	for(uint8_t col = 0; col < BOARD_WIDTH; col++) {
+		column_top[col] = BOARD_ROWS;
+	}
+	for(uint8_t row = BOARD_ROWS; row > 0; row--) {
+		for(uint8_t col = 0; col < BOARD_WIDTH; col++) {
+			if(board[row - 1] & (1 << col)) {
+				column_top[col] = row - 1;
 			}
 		}
 	}
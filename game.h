@@ -7,6 +7,8 @@
  */
 
 #include <stdint.h>
+#include "ledmatrix.h"
+#include "blocks.h"
 
 /*
  * The game board is 16 rows in size. Row 0 is considered to be at the top, 
@@ -18,6 +20,15 @@
 #define MOVE_LEFT 0
 #define MOVE_RIGHT 1
 
+/*
+ * Game actions - see perform_game_action()
+ */
+#define ACTION_MOVE_LEFT 0
+#define ACTION_MOVE_RIGHT 1
+#define ACTION_ROTATE 2
+#define ACTION_DROP 3			// Drop one row (fixing the block if it can't)
+#define ACTION_HARD_DROP 4		// Drop as far as possible and fix the block
+
 /*
  * Initialise the game.
  */
@@ -31,6 +42,12 @@ void init_game(void);
  */
 void update_rows_on_display(uint8_t row_start, uint8_t num_rows);
 
+/*
+ * Get the colours currently displayed for the given board row. Element
+ * 0 of the column is the left of the board.
+ */
+void get_display_row(uint8_t row, MatrixColumn col);
+
 /*
  * attempt_move
  * Attempts a move of the current block in the given direction 
@@ -47,6 +64,12 @@ uint8_t attempt_move(int8_t direction);
  */
 uint8_t attempt_drop_block_one_row(void);
 
+/*
+ * Drop the current block as far as it will go (it is not fixed to the
+ * board). Returns 0 if the block couldn't move, 1 otherwise.
+ */
+uint8_t attempt_hard_drop(void);
+
 /*
  * Attempt rotation (clockwise) of the current block on the board. 
  * Returns 0 on failure, 1 on success. 
@@ -60,15 +83,21 @@ uint8_t attempt_rotation(void);
  */
 uint8_t fix_block_to_board_and_add_new_block(void);
 
-void print_block_preview(void);
-
-void print_square(uint8_t pixel_color);
+/*
+ * Perform the given game action (one of the ACTION_... values above) on
+ * the current block. Returns 0 if the game is over (a block had to be 
+ * fixed to the board and no new block could be added), 1 otherwise.
+ */
+uint8_t perform_game_action(uint8_t action);
 
-#define MATRIX_NUM_ROWS 8
-typedef uint8_t PixelColour;
-typedef PixelColour MatrixColumn[MATRIX_NUM_ROWS];
-void terminal_update_column(uint8_t x, MatrixColumn col);
+/*
+ * Return a hash of the board contents (including the current block). Two
+ * games which end with the same board will have the same hash.
+ */
+uint32_t get_board_hash(void);
 
-void make_sound_high();
-void make_sound_medium();
-void make_sound_low();
\ No newline at end of file
+/*
+ * Return the block which will be added to the board after the current 
+ * one.
+ */
+const FallingBlock* get_next_block(void);
\ No newline at end of file
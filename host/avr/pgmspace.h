@@ -0,0 +1,30 @@
+/*
+ * host/avr/pgmspace.h
+ *
+ * Author: Max Bo
+ *
+ * Host replacement for the avr-libc program memory header. On the host
+ * there is a single address space so "program memory" data is just 
+ * ordinary constant data and the _P functions are the standard ones.
+ */
+
+#ifndef HOST_PGMSPACE_H_
+#define HOST_PGMSPACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+#define pgm_read_ptr(address) (*(const void* const*)(address))
+
+#define printf_P printf
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+#endif /* HOST_PGMSPACE_H_ */
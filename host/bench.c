@@ -0,0 +1,80 @@
+/*
+ * bench.c
+ *
+ * Author: Max Bo
+ *
+ * Host benchmark for the game logic. Plays games with random moves as fast
+ * as possible and reports the move rate and the amount of output that 
+ * would have been sent to the LED matrix and serial terminal.
+ *
+ * Usage: tetris_bench [moves [seed [show_terminal]]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "hal_host.h"
+#include "game.h"
+#include "score.h"
+#include "terminal_board.h"
+#include "blocks.h"
+
+#define DEFAULT_MOVES 1000000L
+
+/* Start a new game as new_game() in project.c does. */
+static void start_game(void) {
+	terminal_board_reset();
+	init_game();
+	init_score();
+	init_cleared_rows();
+}
+
+/* Make a random move and update the terminal. Returns 0 if the game is 
+ * over. */
+static uint8_t random_move(void) {
+	static const uint8_t actions[] = {
+		ACTION_MOVE_LEFT, ACTION_MOVE_LEFT, ACTION_MOVE_RIGHT, 
+		ACTION_MOVE_RIGHT, ACTION_ROTATE, ACTION_DROP, ACTION_DROP,
+		ACTION_HARD_DROP
+	};
+	uint8_t result = perform_game_action(actions[random() % sizeof(actions)]);
+	terminal_board_flush();
+	return result;
+}
+
+int main(int argc, char** argv) {
+	long moves = argc > 1 ? atol(argv[1]) : DEFAULT_MOVES;
+	unsigned seed = argc > 2 ? (unsigned)atol(argv[2]) : 1;
+	uint8_t show_terminal = argc > 3 ? atoi(argv[3]) : 0;
+	
+	init_host(show_terminal);
+	srandom(seed);
+	init_block_generator(seed);
+	
+	struct timespec start, end;
+	long games = 1;
+	start_game();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(long move = 0; move < moves; move++) {
+		if(!random_move()) {
+			games++;
+			start_game();
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	fflush(stdout);
+	
+	double seconds = (end.tv_sec - start.tv_sec) 
+			+ (end.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(stderr, "%ld moves in %.3fs (%.0f moves/s), %ld games\n",
+			moves, seconds, moves / seconds, games);
+	fprintf(stderr, "LED matrix: %lu SPI bytes (%.1f per move)\n",
+			(unsigned long)host_counters.spi_bytes, 
+			(double)host_counters.spi_bytes / moves);
+	fprintf(stderr, "Terminal: %lu serial bytes (%.1f per move)\n",
+			(unsigned long)host_counters.serial_bytes,
+			(double)host_counters.serial_bytes / moves);
+	return 0;
+}
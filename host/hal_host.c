@@ -0,0 +1,102 @@
+/*
+ * hal_host.c
+ *
+ * Author: Max Bo
+ *
+ * Stub hardware backends for the host build. See hal_host.h.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+
+#include "hal_host.h"
+#include "spi.h"
+#include "timer0.h"
+#include "sound.h"
+#include "serialio.h"
+
+HostCounters host_counters;
+
+static uint32_t clock_ticks;
+static uint8_t terminal_visible;
+
+/* stdout is replaced by a stream which counts the bytes written to it
+ * (and passes them on to the real stdout if the terminal is visible).
+ */
+static ssize_t count_serial_output(void* cookie, const char* buf, size_t size) {
+	host_counters.serial_bytes += size;
+	if(terminal_visible) {
+		fwrite(buf, 1, size, (FILE*)cookie);
+	}
+	return size;
+}
+
+void init_host(uint8_t show_terminal) {
+	cookie_io_functions_t functions = { NULL, count_serial_output, NULL, NULL };
+	terminal_visible = show_terminal;
+	stdout = fopencookie(stdout, "w", functions);
+	setvbuf(stdout, NULL, _IOFBF, 4096);
+	host_reset_counters();
+}
+
+void host_reset_counters(void) {
+	fflush(stdout);
+	host_counters.spi_bytes = 0;
+	host_counters.serial_bytes = 0;
+	host_counters.sounds = 0;
+}
+
+void host_set_clock_ticks(uint32_t ticks) {
+	clock_ticks = ticks;
+}
+
+/* spi.h */
+void spi_setup_master(uint8_t clockdivider) {
+}
+
+void spi_queue_byte(uint8_t byte) {
+	host_counters.spi_bytes++;
+}
+
+void spi_flush(void) {
+}
+
+/* serialio.h - written to stdout so that it stays in order with stdio
+ * output (and is counted) */
+void serial_write(const char* data, uint8_t length) {
+	fwrite(data, 1, length, stdout);
+}
+
+void serial_write_P(const char* data, uint8_t length) {
+	fwrite(data, 1, length, stdout);
+}
+
+uint8_t serial_output_space(void) {
+	return 255;
+}
+
+/* timer0.h */
+void init_timer0(void) {
+	clock_ticks = 0;
+}
+
+uint32_t get_clock_ticks(void) {
+	return clock_ticks;
+}
+
+/* sound.h */
+void init_sound(void) {
+}
+
+void make_sound_high(void) {
+	host_counters.sounds++;
+}
+
+void make_sound_medium(void) {
+	host_counters.sounds++;
+}
+
+void make_sound_low(void) {
+	host_counters.sounds++;
+}
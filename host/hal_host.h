@@ -0,0 +1,40 @@
+/*
+ * hal_host.h
+ *
+ * Author: Max Bo
+ *
+ * Host (Linux) implementations of the hardware interface used by the game
+ * logic. The game logic modules (game.c, blocks.c, score.c, ledmatrix.c,
+ * terminalio.c, terminal_board.c) only reach the hardware through the
+ * functions declared in spi.h (SPI), serialio.h (UART - via stdio), 
+ * timer0.h (timer) and sound.h (GPIO), so on the host they are linked 
+ * against the stubs in hal_host.c instead of the AVR drivers. The stubs 
+ * count what would have been sent to the hardware.
+ */
+
+#ifndef HAL_HOST_H_
+#define HAL_HOST_H_
+
+#include <stdint.h>
+
+/* Counts of the output that would have been sent to the hardware since
+ * the last call to host_reset_counters().
+ */
+typedef struct {
+	uint32_t spi_bytes;
+	uint32_t serial_bytes;
+	uint32_t sounds;
+} HostCounters;
+
+extern HostCounters host_counters;
+
+/* Set up the stubs. stdout (the serial terminal) is discarded unless 
+ * show_terminal is non-zero - either way the bytes are counted.
+ */
+void init_host(uint8_t show_terminal);
+void host_reset_counters(void);
+
+/* Set the value returned by get_clock_ticks(). */
+void host_set_clock_ticks(uint32_t ticks);
+
+#endif /* HAL_HOST_H_ */
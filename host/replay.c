@@ -0,0 +1,162 @@
+/*
+ * replay.c (host)
+ *
+ * Author: Max Bo
+ *
+ * Headless replay runner. Reads a replay log - a capture of the terminal
+ * output from a game (see ../replay.h), or just the records from it one
+ * per line - replays the game actions through the game logic as fast as
+ * possible and reports the final board hash, score and number of cleared
+ * rows. If the log includes the results from
+ * the original game, these are compared with the replayed results.
+ *
+ * Usage: tetris_replay [logfile]	(standard input is read if no file
+ *									is given)
+ * Exits with status 1 if the replay doesn't match the original game.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "hal_host.h"
+#include "game.h"
+#include "score.h"
+#include "replay.h"
+#include "terminal_board.h"
+
+static int read_record(FILE* log, char* record, size_t size);
+
+int main(int argc, char** argv) {
+	FILE* log = stdin;
+	if(argc > 1 && (log = fopen(argv[1], "r")) == NULL) {
+		perror(argv[1]);
+		return 2;
+	}
+	
+	init_host(0);
+	
+	char line[80];
+	unsigned long seed;
+	if(!read_record(log, line, sizeof(line)) || 
+			sscanf(line, "REPLAY %lu", &seed) != 1) {
+		fprintf(stderr, "Not a replay log\n");
+		return 2;
+	}
+	
+	// Start the game as new_game() in project.c does
+	terminal_board_reset();
+	init_replay(seed, 0);
+	init_game();
+	init_score();
+	init_cleared_rows();
+	
+	unsigned long events = 0, expected_events, expected_hash, expected_score;
+	unsigned expected_rows;
+	uint8_t have_expected = 0, game_over = 0, truncated = 0;
+	while(read_record(log, line, sizeof(line))) {
+		unsigned long tick;
+		unsigned source, action;
+		if(sscanf(line, "%lu %u %u", &tick, &source, &action) == 3) {
+			if(game_over) {
+				fprintf(stderr, "Event at tick %lu after game over\n", tick);
+				continue;
+			}
+			events++;
+			host_set_clock_ticks(tick);
+			if(!perform_game_action(action)) {
+				game_over = 1;
+			}
+			terminal_board_flush();
+		} else if(strncmp(line, "LOST", 4) == 0) {
+			truncated = 1;
+		} else if(sscanf(line, "END %lu %lu %lu %u", &expected_events,
+				&expected_hash, &expected_score, &expected_rows) == 4) {
+			have_expected = 1;
+		}
+	}
+	fflush(stdout);
+	
+	uint32_t hash = get_board_hash();
+	fprintf(stderr, "seed %lu: %lu events%s%s\n", seed, events,
+			game_over ? ", game over" : "", 
+			truncated ? " (events lost from the log)" : "");
+	fprintf(stderr, "board hash %lu, score %lu, cleared rows %u\n",
+			(unsigned long)hash, (unsigned long)get_score(), 
+			get_cleared_rows());
+	fprintf(stderr, "LED matrix: %lu SPI bytes, terminal: %lu serial bytes\n",
+			(unsigned long)host_counters.spi_bytes,
+			(unsigned long)host_counters.serial_bytes);
+	
+	if(have_expected && !truncated) {
+		if(events != expected_events || hash != expected_hash || 
+				get_score() != expected_score || 
+				get_cleared_rows() != expected_rows) {
+			fprintf(stderr, "MISMATCH: expected board hash %lu, score %lu, "
+					"cleared rows %u\n", expected_hash, expected_score, 
+					expected_rows);
+			return 1;
+		}
+		fprintf(stderr, "MATCH\n");
+	}
+	return 0;
+}
+
+/*
+ * Read the next record from the log into record. If the log contains 
+ * ESC _ it is a capture of the terminal output, and the records are what
+ * is inside each ESC _ ... ESC \ (everything else is skipped). Otherwise
+ * each line is a record. Returns 0 at the end of the log.
+ */
+static int read_record(FILE* log, char* record, size_t size) {
+	static char* text;
+	static size_t length, position;
+	static uint8_t is_capture;
+	if(!text) {
+		// Read the whole log
+		size_t allocated = 4096;
+		text = malloc(allocated);
+		size_t n;
+		while(text && (n = fread(text + length, 1, allocated - length - 1,
+				log)) > 0) {
+			length += n;
+			if(length + 1 == allocated) {
+				text = realloc(text, allocated *= 2);
+			}
+		}
+		if(!text) {
+			return 0;
+		}
+		text[length] = '\0';
+		is_capture = (strstr(text, "\x1b_") != NULL);
+	}
+	
+	const char* start = text + position;
+	const char* end;
+	if(is_capture) {
+		if((start = strstr(start, "\x1b_")) == NULL) {
+			return 0;
+		}
+		start += 2;
+		if((end = strstr(start, "\x1b\\")) == NULL) {
+			return 0;	// Incomplete record at the end of the capture
+		}
+		position = end + 2 - text;
+	} else {
+		if(*start == '\0') {
+			return 0;
+		}
+		if((end = strchr(start, '\n')) == NULL) {
+			end = start + strlen(start);
+		}
+		position = end - text + (*end == '\n');
+	}
+	size_t record_length = end - start;
+	if(record_length > size - 1) {
+		record_length = size - 1;
+	}
+	memcpy(record, start, record_length);
+	record[record_length] = '\0';
+	return 1;
+}
@@ -0,0 +1,84 @@
+/*
+ * input_queue.c
+ *
+ * Author: Max Bo
+ *
+ * The queue is a circular buffer. There are several producers (interrupt
+ * handlers and the main program) but only one consumer (the main 
+ * program via get_input()). Producers add events with interrupts
+ * disabled, so they can't interfere with each other. Only the producers
+ * change queue_head and only the consumer changes queue_tail; both are
+ * single bytes (so are read and written atomically) and count up 
+ * continuously, wrapping around at 256 - the number of entries in the 
+ * queue is queue_head - queue_tail and an index into the queue is found
+ * by masking off the low bits. This is why INPUT_QUEUE_SIZE must be a 
+ * power of 2 (no larger than 128). An entry is written before 
+ * queue_head is advanced, so the consumer never sees a partly written 
+ * entry and doesn't need to disable interrupts.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "input_queue.h"
+
+#define INPUT_QUEUE_SIZE 16
+#define INPUT_QUEUE_MASK (INPUT_QUEUE_SIZE - 1)
+
+static volatile QueuedInput input_queue[INPUT_QUEUE_SIZE];
+static volatile uint8_t queue_head;
+static volatile uint8_t queue_tail;
+
+// Number of events discarded because the queue was full. Only changed 
+// with interrupts disabled.
+static volatile uint16_t queue_overflows;
+
+void queue_input(uint8_t source, uint8_t code, uint32_t time) {
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	uint8_t head = queue_head;
+	if((uint8_t)(head - queue_tail) >= INPUT_QUEUE_SIZE) {
+		if(queue_overflows < UINT16_MAX) {
+			queue_overflows++;
+		}
+	} else {
+		input_queue[head & INPUT_QUEUE_MASK].time = time;
+		input_queue[head & INPUT_QUEUE_MASK].source = source;
+		input_queue[head & INPUT_QUEUE_MASK].code = code;
+		// Advance the head only once the entry is written - this makes the
+		// entry available to get_input()
+		queue_head = head + 1;
+	}
+	if(interrupts_were_on) {
+		sei();
+	}
+}
+
+uint8_t get_input(QueuedInput* input) {
+	uint8_t tail = queue_tail;
+	if(tail == queue_head) {
+		return 0;	// Queue is empty
+	}
+	// Copy the entry at the tail of the queue then advance the tail (which
+	// frees up the entry for the producers)
+	input->time = input_queue[tail & INPUT_QUEUE_MASK].time;
+	input->source = input_queue[tail & INPUT_QUEUE_MASK].source;
+	input->code = input_queue[tail & INPUT_QUEUE_MASK].code;
+	queue_tail = tail + 1;
+	return 1;
+}
+
+void empty_input_queue(void) {
+	// Discard everything that has been added so far
+	queue_tail = queue_head;
+}
+
+uint16_t get_input_queue_overflows(void) {
+	// The count may change while we read it (it's two bytes) - read it
+	// until we get the same value twice.
+	uint16_t overflows;
+	do {
+		overflows = queue_overflows;
+	} while(overflows != queue_overflows);
+	return overflows;
+}
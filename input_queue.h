@@ -0,0 +1,56 @@
+/*
+ * input_queue.h
+ *
+ * Author: Max Bo
+ *
+ * A single queue of input events from all the input sources - the 
+ * buttons (added by the timer interrupt handler as the buttons are 
+ * sampled), the serial terminal (added by the keyboard decoder as the
+ * characters are received) and the joystick. Each event records when it
+ * happened, so events are taken from the queue in the order they arrived
+ * whatever their source.
+ */
+
+#ifndef INPUT_QUEUE_H_
+#define INPUT_QUEUE_H_
+
+#include <stdint.h>
+
+/* Input sources */
+#define INPUT_BUTTON 0
+#define INPUT_SERIAL 1
+#define INPUT_JOYSTICK 2
+#define INPUT_GRAVITY 3		// Not queued - the block dropping on time
+
+/* An input event. The code is the button number (see buttons.h), key 
+ * (see keyboard.h) or joystick event (see joystick.h) depending on the 
+ * source. time is the clock tick (see timer0.h) at which it happened.
+ */
+typedef struct {
+	uint32_t time;
+	uint8_t source;
+	uint8_t code;
+} QueuedInput;
+
+/* Add an event to the queue. If the queue is full the event is discarded
+ * (and counted). May be called from interrupt handlers or with 
+ * interrupts enabled.
+ */
+void queue_input(uint8_t source, uint8_t code, uint32_t time);
+
+/* Remove the oldest event from the queue and copy it to input. Returns 1
+ * if there was an event, 0 if the queue is empty. Must only be called 
+ * from the main program (not from interrupt handlers).
+ */
+uint8_t get_input(QueuedInput* input);
+
+/* Discard all the events in the queue.
+ */
+void empty_input_queue(void);
+
+/* Return the number of events which have been discarded because the 
+ * queue was full.
+ */
+uint16_t get_input_queue_overflows(void);
+
+#endif /* INPUT_QUEUE_H_ */
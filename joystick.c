@@ -0,0 +1,209 @@
+/*
+ * joystick.c
+ *
+ * Author: Max Bo
+ *
+ * The ADC is run in free running mode: a new conversion starts as soon
+ * as the previous one finishes, using the channel selected in ADMUX at
+ * that moment. When the ADC interrupt handler runs for one conversion the
+ * next has therefore already started, so a channel change made in the
+ * handler applies to the conversion after next. We keep track of which
+ * channel each conversion is for and alternate between the channels, so
+ * every result is used. Each axis is filtered with a moving average of
+ * the last JOYSTICK_FILTER_SAMPLES results.
+ *
+ * joystick_event() turns the positions into events. An axis becomes
+ * active when it is pushed more than JOYSTICK_PRESS_DEFLECTION from the
+ * centre and stays active until it comes back within 
+ * JOYSTICK_RELEASE_DEFLECTION, so noise near the threshold can't cause
+ * extra events.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "joystick.h"
+#include "timer0.h"
+
+#define JOYSTICK_X_CHANNEL 0
+#define JOYSTICK_Y_CHANNEL 1
+
+// Must be a power of 2
+#define JOYSTICK_FILTER_SAMPLES 4
+
+// Recent results for each channel and their sums. Only used by the 
+// interrupt handler.
+static uint16_t samples[2][JOYSTICK_FILTER_SAMPLES];
+static uint16_t sample_sum[2];
+static uint8_t sample_index[2];
+
+// Channels of the conversion the interrupt handler is called for and of 
+// the conversion in progress when it runs
+static uint8_t completed_channel;
+static uint8_t converting_channel;
+
+// Filtered positions. These are written only by the interrupt handler.
+static volatile uint16_t joystick_position[2];
+
+// Deflections (distance from the centre) at which an axis becomes 
+// active and inactive again
+#define JOYSTICK_PRESS_DEFLECTION 338
+#define JOYSTICK_RELEASE_DEFLECTION 250
+#define JOYSTICK_MAX_DEFLECTION 511
+
+// Repeat intervals (ms) at the press deflection and at full deflection.
+// Rotation always repeats at JOYSTICK_ROTATE_INTERVAL.
+#define JOYSTICK_SLOW_INTERVAL 200
+#define JOYSTICK_FAST_INTERVAL 50
+#define JOYSTICK_ROTATE_INTERVAL 300
+
+// Event state for each axis - the event being repeated (-1 if the axis
+// is centred) and the time the next repeat is due
+static int8_t axis_event[2];
+static uint32_t axis_repeat_time[2];
+
+// Axis to check first next time, so that one held axis can't starve the other
+static uint8_t first_axis;
+
+static uint16_t read_position(uint8_t channel);
+static int8_t axis_event_due(uint8_t axis, uint32_t now);
+
+void init_joystick(void) {
+	for(uint8_t channel = 0; channel < 2; channel++) {
+		for(uint8_t i = 0; i < JOYSTICK_FILTER_SAMPLES; i++) {
+			samples[channel][i] = 512;
+		}
+		sample_sum[channel] = 512 * JOYSTICK_FILTER_SAMPLES;
+		sample_index[channel] = 0;
+		joystick_position[channel] = 512;
+		axis_event[channel] = -1;
+	}
+	first_axis = 0;
+	
+	// Disable the digital inputs on the joystick pins (saves power)
+	DIDR0 = (1<<ADC0D)|(1<<ADC1D);
+	
+	// AVCC reference, start with the x channel. The first two conversions
+	// will both be on this channel.
+	ADMUX = (1<<REFS0) | JOYSTICK_X_CHANNEL;
+	completed_channel = JOYSTICK_X_CHANNEL;
+	converting_channel = JOYSTICK_X_CHANNEL;
+	
+	// Free running mode (auto trigger source 0)
+	ADCSRB = 0;
+	
+	// Enable the ADC with auto triggering and the conversion complete
+	// interrupt, divide the clock by 128 (62.5kHz ADC clock, about 4800
+	// conversions per second) and start converting.
+	ADCSRA = (1<<ADEN)|(1<<ADSC)|(1<<ADATE)|(1<<ADIE)|
+			(1<<ADPS2)|(1<<ADPS1)|(1<<ADPS0);
+}
+
+uint16_t get_joystick_x(void) {
+	return read_position(JOYSTICK_X_CHANNEL);
+}
+
+uint16_t get_joystick_y(void) {
+	return read_position(JOYSTICK_Y_CHANNEL);
+}
+
+int8_t joystick_event(void) {
+	uint32_t now = get_clock_ticks();
+	uint8_t axis = first_axis;
+	first_axis = !first_axis;
+	
+	int8_t event = axis_event_due(axis, now);
+	if(event == -1) {
+		event = axis_event_due(!axis, now);
+	}
+	return event;
+}
+
+/*
+ * Update the state of the given axis and return its event if one is 
+ * due (otherwise -1). 
+ */
+static int8_t axis_event_due(uint8_t axis, uint32_t now) {
+	uint16_t position = read_position(axis);
+	uint16_t deflection;
+	int8_t event;
+	if(position >= 512) {
+		deflection = position - 512;
+		event = (axis == JOYSTICK_X_CHANNEL) ? JOYSTICK_LEFT : JOYSTICK_UP;
+	} else {
+		deflection = 512 - position;
+		event = (axis == JOYSTICK_X_CHANNEL) ? JOYSTICK_RIGHT : JOYSTICK_DOWN;
+	}
+	
+	if(axis_event[axis] != event) {
+		// Axis isn't active in this direction - see if it has just been pushed
+		if(deflection >= JOYSTICK_PRESS_DEFLECTION) {
+			axis_event[axis] = event;
+		} else {
+			if(deflection < JOYSTICK_RELEASE_DEFLECTION) {
+				axis_event[axis] = -1;
+			}
+			return -1;
+		}
+	} else if(deflection < JOYSTICK_RELEASE_DEFLECTION) {
+		// Released
+		axis_event[axis] = -1;
+		return -1;
+	} else if((int32_t)(now - axis_repeat_time[axis]) < 0) {
+		// Held, but the next repeat isn't due yet
+		return -1;
+	}
+	
+	// Work out when the next repeat is due
+	uint16_t interval;
+	if(event == JOYSTICK_UP) {
+		interval = JOYSTICK_ROTATE_INTERVAL;
+	} else if(deflection >= JOYSTICK_MAX_DEFLECTION) {
+		interval = JOYSTICK_FAST_INTERVAL;
+	} else if(deflection <= JOYSTICK_PRESS_DEFLECTION) {
+		interval = JOYSTICK_SLOW_INTERVAL;
+	} else {
+		interval = JOYSTICK_SLOW_INTERVAL - 
+				(uint32_t)(deflection - JOYSTICK_PRESS_DEFLECTION) *
+				(JOYSTICK_SLOW_INTERVAL - JOYSTICK_FAST_INTERVAL) /
+				(JOYSTICK_MAX_DEFLECTION - JOYSTICK_PRESS_DEFLECTION);
+	}
+	axis_repeat_time[axis] = now + interval;
+	return event;
+}
+
+/*
+ * Return the position for the given channel. The value is two bytes and
+ * the interrupt handler could change it while we're reading it, so we
+ * read it until we get the same value twice.
+ */
+static uint16_t read_position(uint8_t channel) {
+	uint16_t position;
+	do {
+		position = joystick_position[channel];
+	} while(position != joystick_position[channel]);
+	return position;
+}
+
+/*
+ * Interrupt handler for ADC conversion complete
+ */
+ISR(ADC_vect) {
+	uint8_t channel = completed_channel;
+	
+	// Select the other channel for the conversion after the one in
+	// progress, and record which channels the next results will be for
+	uint8_t next_channel = !converting_channel;
+	ADMUX = (1<<REFS0) | next_channel;
+	completed_channel = converting_channel;
+	converting_channel = next_channel;
+	
+	// Replace the oldest sample for this channel with the new result 
+	// and publish the new average
+	uint16_t result = ADC;
+	uint8_t index = sample_index[channel];
+	sample_sum[channel] += result - samples[channel][index];
+	samples[channel][index] = result;
+	sample_index[channel] = (index + 1) & (JOYSTICK_FILTER_SAMPLES - 1);
+	joystick_position[channel] = sample_sum[channel] / JOYSTICK_FILTER_SAMPLES;
+}
@@ -0,0 +1,45 @@
+/*
+ * joystick.h
+ *
+ * Author: Max Bo
+ *
+ * The joystick's x and y outputs are connected to ADC channels 0 and 1
+ * (pins A0 and A1). Both channels are converted continuously by the ADC
+ * interrupt handler, so the latest (filtered) positions can be read at 
+ * any time without waiting for a conversion. Interrupts must be enabled
+ * globally for the positions to be updated.
+ */
+
+#ifndef JOYSTICK_H_
+#define JOYSTICK_H_
+
+#include <stdint.h>
+
+/* Set up the ADC and start converting. 
+ */
+void init_joystick(void);
+
+/* Return the current joystick position on each axis - from 0 to 1023, 
+ * about 512 when the joystick is centred.
+ */
+uint16_t get_joystick_x(void);
+uint16_t get_joystick_y(void);
+
+/* Joystick events. The left, right and up events are the same as the 
+ * numbers of the buttons that perform those actions so they can be 
+ * handled the same way as button pushes.
+ */
+#define JOYSTICK_RIGHT 0
+#define JOYSTICK_UP 2
+#define JOYSTICK_LEFT 3
+#define JOYSTICK_DOWN 4
+
+/* Return the next joystick event or -1 if there is none. This should be 
+ * called regularly from the main loop. Each axis is handled separately:
+ * pushing the joystick away from the centre gives an event straight away
+ * and then repeated events while it is held there. Left, right and down
+ * repeat faster the further the joystick is pushed.
+ */
+int8_t joystick_event(void);
+
+#endif /* JOYSTICK_H_ */
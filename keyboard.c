@@ -0,0 +1,210 @@
+/*
+ * keyboard.c
+ *
+ * Author: Max Bo
+ *
+ * The decoder is a state machine. ESC starts a sequence; it is followed
+ * by [ (a control sequence - CSI) or O (SS3). A control sequence can 
+ * have numeric parameters separated by ; before its final character. The
+ * key is found by looking up the final character (and for ~ the first 
+ * parameter) in the tables below.
+ * Characters are decoded in the serial receive interrupt handler as they
+ * arrive, so keys are added to the input queue in order with the button
+ * pushes (which are added from the timer interrupt handler). The timeout
+ * is checked when each character arrives (so a character that arrives
+ * late isn't taken as part of a stale sequence) and from the main 
+ * program, with interrupts disabled while the decoder state is looked at.
+ */
+
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "keyboard.h"
+#include "serialio.h"
+#include "timer0.h"
+#include "input_queue.h"
+
+#define ESCAPE_CHAR 27
+
+/* Decoder states */
+#define STATE_GROUND 0		// Not in a sequence
+#define STATE_ESCAPE 1		// Received ESC
+#define STATE_CSI 2			// Received ESC [ (and maybe some parameters)
+#define STATE_SS3 3			// Received ESC O
+
+/* Maximum value of a parameter (larger values are kept at this) */
+#define MAX_PARAMETER 99
+
+/* Keys for the final characters of ESC [ and ESC O sequences. */
+typedef struct {
+	char final;
+	uint8_t key;
+} FinalKey;
+
+static const FinalKey final_keys[] PROGMEM = {
+	{'A', KEY_UP}, {'B', KEY_DOWN}, {'C', KEY_RIGHT}, {'D', KEY_LEFT},
+	{'H', KEY_HOME}, {'F', KEY_END}, 
+	{'P', KEY_F1}, {'Q', KEY_F1 + 1}, {'R', KEY_F1 + 2}, {'S', KEY_F1 + 3}
+};
+
+/* Keys for ESC [ n ~ sequences, indexed by n */
+static const uint8_t tilde_keys[] PROGMEM = {
+	KEY_NONE, KEY_HOME, KEY_INSERT, KEY_DELETE, KEY_END, KEY_PAGE_UP, 
+	KEY_PAGE_DOWN, KEY_HOME, KEY_END, KEY_NONE, KEY_NONE,
+	KEY_F1, KEY_F1 + 1, KEY_F1 + 2, KEY_F1 + 3, KEY_F1 + 4, KEY_NONE,
+	KEY_F1 + 5, KEY_F1 + 6, KEY_F1 + 7, KEY_F1 + 8, KEY_F1 + 9, KEY_NONE,
+	KEY_F1 + 10, KEY_F1 + 11
+};
+
+#define NUM_FINAL_KEYS (sizeof(final_keys) / sizeof(final_keys[0]))
+#define NUM_TILDE_KEYS (sizeof(tilde_keys) / sizeof(tilde_keys[0]))
+
+/* Decoder state. first_parameter is the first parameter of the control 
+ * sequence being received and parameter_count counts the parameters
+ * started. sequence_time is when the last character was received (the 
+ * time given to the keys queued).
+ */
+static volatile uint8_t state;
+static uint8_t first_parameter;
+static uint8_t parameter_count;
+static volatile uint32_t sequence_time;
+
+static void decode_character(char c);
+static void check_sequence_timeout(uint32_t now);
+static void decode_final(char c);
+static void queue_key(uint8_t key);
+
+void init_keyboard(void) {
+	reset_keyboard();
+	set_serial_input_handler(decode_character);
+}
+
+void check_keyboard_timeout(void) {
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	check_sequence_timeout(get_clock_ticks());
+	if(interrupts_were_on) {
+		sei();
+	}
+}
+
+void reset_keyboard(void) {
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	state = STATE_GROUND;
+	if(interrupts_were_on) {
+		sei();
+	}
+}
+
+/*
+ * Decode the next character received. This is called from the serial 
+ * receive interrupt handler as each character arrives.
+ */
+static void decode_character(char c) {
+	uint32_t now = get_clock_ticks();
+	check_sequence_timeout(now);
+	sequence_time = now;
+	
+	switch(state) {
+		case STATE_ESCAPE:
+			if(c == '[') {
+				state = STATE_CSI;
+				first_parameter = 0;
+				parameter_count = 0;
+				return;
+			} else if(c == 'O') {
+				state = STATE_SS3;
+				return;
+			}
+			// Not a sequence we know - the escape was the Escape key
+			// and this character starts again
+			queue_key(KEY_ESCAPE);
+			break;
+		
+		case STATE_CSI:
+			if(c >= '0' && c <= '9') {
+				// Parameter digit. We only need the first parameter.
+				if(parameter_count == 0) {
+					parameter_count = 1;
+				}
+				if(parameter_count == 1) {
+					first_parameter = first_parameter * 10 + (c - '0');
+					if(first_parameter > MAX_PARAMETER) {
+						first_parameter = MAX_PARAMETER;
+					}
+				}
+				return;
+			} else if(c == ';') {
+				parameter_count++;
+				return;
+			} else if(c >= 0x40 && c <= 0x7E) {
+				decode_final(c);
+				state = STATE_GROUND;
+				return;
+			}
+			// Invalid character - discard the sequence and start again
+			break;
+		
+		case STATE_SS3:
+			if(c >= 0x40 && c <= 0x7E) {
+				decode_final(c);
+				state = STATE_GROUND;
+				return;
+			}
+			break;
+	}
+	
+	state = STATE_GROUND;
+	if(c == ESCAPE_CHAR) {
+		state = STATE_ESCAPE;
+	} else if((uint8_t)c < 0x80) {
+		// (Characters outside the ASCII range are ignored - they would
+		// clash with our key codes.)
+		queue_key(c);
+	}
+}
+
+/*
+ * If a sequence has been waiting too long for its next character give up
+ * on it. An escape on its own was the Escape key.
+ */
+static void check_sequence_timeout(uint32_t now) {
+	if(state != STATE_GROUND && 
+			now - sequence_time > KEYBOARD_SEQUENCE_TIMEOUT) {
+		if(state == STATE_ESCAPE) {
+			queue_key(KEY_ESCAPE);
+		}
+		state = STATE_GROUND;
+	}
+}
+
+/*
+ * Queue the key (if any) for the sequence with final character c.
+ */
+static void decode_final(char c) {
+	if(c == '~') {
+		if(first_parameter < NUM_TILDE_KEYS) {
+			queue_key(pgm_read_byte(&tilde_keys[first_parameter]));
+		}
+		return;
+	}
+	for(uint8_t i = 0; i < NUM_FINAL_KEYS; i++) {
+		if(pgm_read_byte(&final_keys[i].final) == c) {
+			queue_key(pgm_read_byte(&final_keys[i].key));
+			return;
+		}
+	}
+}
+
+/*
+ * Add a key to the input queue.
+ */
+static void queue_key(uint8_t key) {
+	if(key != KEY_NONE) {
+		queue_input(INPUT_SERIAL, key, sequence_time);
+	}
+}
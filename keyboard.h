@@ -0,0 +1,59 @@
+/*
+ * keyboard.h
+ *
+ * Author: Max Bo
+ *
+ * Decodes the characters received from the serial terminal into key 
+ * presses as they arrive. The keys are added to the input queue (see 
+ * input_queue.h) with
+ * source INPUT_SERIAL and the key as the code. Ordinary characters are
+ * passed on as they are. The escape 
+ * sequences sent by the cursor, editing and function keys (ESC [ ... and
+ * ESC O ...) are turned into the KEY_ codes below. An escape character 
+ * which isn't followed by the rest of a sequence within 
+ * KEYBOARD_SEQUENCE_TIMEOUT milliseconds is the Escape key, and an 
+ * incomplete or unknown sequence is discarded, so a lost character can't
+ * leave the decoder stuck part way through a sequence.
+ */
+
+#ifndef KEYBOARD_H_
+#define KEYBOARD_H_
+
+#include <stdint.h>
+
+#define KEYBOARD_SEQUENCE_TIMEOUT 20
+
+/* Codes for keys which don't send a single character. These are outside
+ * the range of ASCII characters. 
+ */
+#define KEY_NONE 0
+#define KEY_ESCAPE 27
+#define KEY_UP 0x80
+#define KEY_DOWN 0x81
+#define KEY_RIGHT 0x82
+#define KEY_LEFT 0x83
+#define KEY_HOME 0x84
+#define KEY_END 0x85
+#define KEY_INSERT 0x86
+#define KEY_DELETE 0x87
+#define KEY_PAGE_UP 0x88
+#define KEY_PAGE_DOWN 0x89
+#define KEY_F1 0x90		// KEY_F1 + n - 1 is function key n (up to 12)
+
+/* Start decoding the characters received from the serial port (which 
+ * must have been initialised - see serialio.h). Characters are no longer
+ * available from stdin.
+ */
+void init_keyboard(void);
+
+/* Finish an escape sequence which has been waiting too long for its next
+ * character. This should be called regularly (at least every 
+ * KEYBOARD_SEQUENCE_TIMEOUT ms).
+ */
+void check_keyboard_timeout(void);
+
+/* Discard any partly received escape sequence.
+ */
+void reset_keyboard(void);
+
+#endif /* KEYBOARD_H_ */
@@ -4,9 +4,15 @@
  * Author: Peter Sutton
  * 
  * See the LED matrix Reference for details of the SPI commands used.
+ * Commands are queued for output (see spi.h) so the update functions
+ * return without waiting for the SPI transfers to complete.
+ *
+ * We keep a shadow copy of what the LED matrix is currently displaying.
+ * Every command we send is also applied to the shadow copy. This allows
+ * the ledmatrix_sync_...() functions to send only what has changed, using 
+ * whichever commands need the fewest SPI bytes.
  */ 
 
-#include <avr/io.h>
 #include "ledmatrix.h"
 #include "spi.h"
 
@@ -17,66 +23,167 @@
 #define CMD_SHIFT_DISPLAY 0x04
 #define CMD_CLEAR_SCREEN 0x0F
 
+// Number of SPI bytes needed by each of the update commands
+#define PIXEL_UPDATE_BYTES 3
+#define COLUMN_UPDATE_BYTES (2 + MATRIX_NUM_ROWS)
+#define ALL_UPDATE_BYTES (1 + MATRIX_NUM_COLUMNS * MATRIX_NUM_ROWS)
+
+#if MATRIX_SYNC_ALL_COLUMNS != ALL_UPDATE_BYTES / COLUMN_UPDATE_BYTES + 1
+#error MATRIX_SYNC_ALL_COLUMNS does not match the command sizes
+#endif
+
+// What the LED matrix is currently displaying
+static MatrixData shadow;
+
+static uint8_t column_differences(uint8_t x, MatrixColumn col);
+static uint8_t column_update_cost(uint8_t differences);
+static void set_shadow_to_colour(PixelColour colour);
+
 void ledmatrix_setup(void) {
 	// Setup SPI - we divide the clock by 128.
 	// (This speed guarantees the SPI buffer will never overflow on
 	// the LED matrix.)
 	spi_setup_master(128);
+	
+	// We don't know what the display is showing at startup so we
+	// clear it (this also clears our shadow copy).
+	ledmatrix_clear();
+}
+
+void ledmatrix_flush(void) {
+	spi_flush();
 }
 
 void ledmatrix_update_all(MatrixData data) {
-	(void)spi_send_byte(CMD_UPDATE_ALL);
+	spi_queue_byte(CMD_UPDATE_ALL);
 	for(uint8_t y=0; y<MATRIX_NUM_ROWS; y++) {
 		for(uint8_t x=0; x<MATRIX_NUM_COLUMNS; x++) {
-			(void)spi_send_byte(data[x][y]);
+			spi_queue_byte(data[x][y]);
+			shadow[x][y] = data[x][y];
 		}
 	}
 }
 
 void ledmatrix_update_pixel(uint8_t x, uint8_t y, PixelColour pixel) {
-	(void)spi_send_byte(CMD_UPDATE_PIXEL);
-	(void)spi_send_byte( ((y & 0x07)<<4) | (x & 0x0F));
-	(void)spi_send_byte(pixel);
+	spi_queue_byte(CMD_UPDATE_PIXEL);
+	spi_queue_byte( ((y & 0x07)<<4) | (x & 0x0F));
+	spi_queue_byte(pixel);
+	shadow[x & 0x0F][y & 0x07] = pixel;
 }
 
 void ledmatrix_update_row(uint8_t y, MatrixRow row) {
-	(void)spi_send_byte(CMD_UPDATE_ROW);
-	(void)spi_send_byte(y & 0x07);	// row number
+	spi_queue_byte(CMD_UPDATE_ROW);
+	spi_queue_byte(y & 0x07);	// row number
 	for(uint8_t x = 0; x<MATRIX_NUM_COLUMNS; x++) {
-		(void)spi_send_byte(row[x]);
+		spi_queue_byte(row[x]);
+		shadow[x][y & 0x07] = row[x];
 	}
 }
 
 void ledmatrix_update_column(uint8_t x, MatrixColumn col) {
-	(void)spi_send_byte(CMD_UPDATE_COL);
-	(void)spi_send_byte(x & 0x0F); // column number
+	spi_queue_byte(CMD_UPDATE_COL);
+	spi_queue_byte(x & 0x0F); // column number
 	for(uint8_t y = 0; y<MATRIX_NUM_ROWS; y++) {
-		(void)spi_send_byte(col[y]);
+		spi_queue_byte(col[y]);
+		shadow[x & 0x0F][y] = col[y];
 	}
 }
 
 void ledmatrix_shift_display_left(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x02);
+	spi_queue_byte(CMD_SHIFT_DISPLAY);
+	spi_queue_byte(0x02);
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS - 1; x++) {
+		copy_matrix_column(shadow[x + 1], shadow[x]);
+	}
+	set_matrix_column_to_colour(shadow[MATRIX_NUM_COLUMNS - 1], COLOUR_BLACK);
 }
 
 void ledmatrix_shift_display_right(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x01);
+	spi_queue_byte(CMD_SHIFT_DISPLAY);
+	spi_queue_byte(0x01);
+	for(uint8_t x = MATRIX_NUM_COLUMNS - 1; x > 0; x--) {
+		copy_matrix_column(shadow[x - 1], shadow[x]);
+	}
+	set_matrix_column_to_colour(shadow[0], COLOUR_BLACK);
 }
 
 void ledmatrix_shift_display_up(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x08);
+	spi_queue_byte(CMD_SHIFT_DISPLAY);
+	spi_queue_byte(0x08);
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		for(uint8_t y = MATRIX_NUM_ROWS - 1; y > 0; y--) {
+			shadow[x][y] = shadow[x][y - 1];
+		}
+		shadow[x][0] = COLOUR_BLACK;
+	}
 }
 
 void ledmatrix_shift_display_down(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x04);
+	spi_queue_byte(CMD_SHIFT_DISPLAY);
+	spi_queue_byte(0x04);
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		for(uint8_t y = 0; y < MATRIX_NUM_ROWS - 1; y++) {
+			shadow[x][y] = shadow[x][y + 1];
+		}
+		shadow[x][MATRIX_NUM_ROWS - 1] = COLOUR_BLACK;
+	}
 }
 
 void ledmatrix_clear(void) {
-	(void)spi_send_byte(CMD_CLEAR_SCREEN);
+	spi_queue_byte(CMD_CLEAR_SCREEN);
+	set_shadow_to_colour(COLOUR_BLACK);
+}
+
+void ledmatrix_sync_column(uint8_t x, MatrixColumn col) {
+	uint8_t differences = column_differences(x, col);
+	if(differences == 0) {
+		return;	// Already displayed
+	}
+	if(differences * PIXEL_UPDATE_BYTES < COLUMN_UPDATE_BYTES) {
+		// Cheaper to update the pixels individually
+		for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+			if(shadow[x][y] != col[y]) {
+				ledmatrix_update_pixel(x, y, col[y]);
+			}
+		}
+	} else {
+		ledmatrix_update_column(x, col);
+	}
+}
+
+void ledmatrix_sync_all(MatrixColumnSource get_column) {
+	// Work out how many bytes it would cost to update the columns
+	// individually, and whether the new display is completely black
+	MatrixColumn col;
+	uint16_t cost = 0;
+	uint8_t all_black = 1;
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		get_column(x, col);
+		cost += column_update_cost(column_differences(x, col));
+		for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+			if(col[y] != COLOUR_BLACK) {
+				all_black = 0;
+			}
+		}
+	}
+	
+	if(cost == 0) {
+		return;	// Nothing has changed
+	} else if(all_black) {
+		ledmatrix_clear();	// A single byte
+	} else if(cost > ALL_UPDATE_BYTES) {
+		// Put the new display straight into the shadow copy, then send 
+		// all of it
+		for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+			get_column(x, shadow[x]);
+		}
+		ledmatrix_update_all(shadow);
+	} else {
+		for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+			get_column(x, col);
+			ledmatrix_sync_column(x, col);
+		}
+	}
 }
 
 void copy_matrix_column(MatrixColumn from, MatrixColumn to) {
@@ -101,4 +208,36 @@ void set_matrix_row_to_colour(MatrixRow matrix_row, PixelColour colour) {
 	for(uint8_t column = 0; column < MATRIX_NUM_COLUMNS; column++) {
 		matrix_row[column] = colour;
 	}
+}
+
+/*
+ * Return the number of pixels in column x of the display which differ
+ * from the given column.
+ */
+static uint8_t column_differences(uint8_t x, MatrixColumn col) {
+	uint8_t differences = 0;
+	for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+		if(shadow[x][y] != col[y]) {
+			differences++;
+		}
+	}
+	return differences;
+}
+
+/*
+ * Return the number of SPI bytes ledmatrix_sync_column() will send for a
+ * column with the given number of differing pixels.
+ */
+static uint8_t column_update_cost(uint8_t differences) {
+	uint8_t cost = differences * PIXEL_UPDATE_BYTES;
+	if(cost > COLUMN_UPDATE_BYTES) {
+		cost = COLUMN_UPDATE_BYTES;
+	}
+	return cost;
+}
+
+static void set_shadow_to_colour(PixelColour colour) {
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		set_matrix_column_to_colour(shadow[x], colour);
+	}
 }
\ No newline at end of file
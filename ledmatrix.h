@@ -26,7 +26,10 @@ typedef PixelColour MatrixColumn[MATRIX_NUM_ROWS];
 // below are used.
 void ledmatrix_setup(void);
 
-// Functions to update the display
+// Functions to update the display. These queue the required commands
+// for output and return immediately - ledmatrix_flush() can be used to 
+// wait until all queued commands have been sent to the LED matrix.
+void ledmatrix_flush(void);
 void ledmatrix_update_all(MatrixData data);
 void ledmatrix_update_pixel(uint8_t x, uint8_t y, PixelColour pixel);
 void ledmatrix_update_row(uint8_t y, MatrixRow row);
@@ -37,6 +40,21 @@ void ledmatrix_shift_display_up(void);
 void ledmatrix_shift_display_down(void);
 void ledmatrix_clear(void);
 
+// Functions to bring the display up to date with the given data. Only 
+// pixels which differ from what is currently displayed are sent, using 
+// whichever commands require the fewest bytes to be sent to the matrix.
+void ledmatrix_sync_column(uint8_t x, MatrixColumn col);
+// ledmatrix_sync_all() gets each column of the new display in turn from
+// get_column (so the whole display never needs to be held in RAM) - it 
+// may be asked for a column more than once.
+typedef void (*MatrixColumnSource)(uint8_t x, MatrixColumn col);
+void ledmatrix_sync_all(MatrixColumnSource get_column);
+
+// ledmatrix_sync_all() can send the whole display in one command (129 
+// bytes). This can only be cheaper than syncing columns one at a time (up
+// to 10 bytes each) if at least this many columns have changed.
+#define MATRIX_SYNC_ALL_COLUMNS 13
+
 // Functions to operate on rows and columns
 void copy_matrix_column(MatrixColumn from, MatrixColumn to);
 void copy_matrix_row(MatrixRow from, MatrixRow to);
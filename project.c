@@ -17,9 +17,16 @@
 #include "buttons.h"
 #include "serialio.h"
 #include "terminalio.h"
+#include "terminal_board.h"
 #include "score.h"
 #include "timer0.h"
 #include "game.h"
+#include "sound.h"
+#include "replay.h"
+#include "joystick.h"
+#include "seven_seg.h"
+#include "keyboard.h"
+#include "input_queue.h"
 
 #define F_CPU 8000000L
 #include <util/delay.h>
@@ -30,17 +37,15 @@ void initialise_hardware(void);
 void splash_screen(void);
 void new_game(void);
 void play_game(void);
+uint16_t drop_interval(void);
+void drop_block_on_time(void);
+void handle_input(void);
+int8_t input_action(const QueuedInput* input);
+void handle_joystick(void);
+void update_terminal(void);
+void perform_action(uint8_t source, uint8_t action);
 void handle_game_over(void);
 void handle_new_lap(void);
-void update_seven_segment(void);
-void convert_joystick(void);
-uint8_t is_left(void);
-uint8_t is_right(void);
-uint8_t is_up(void);
-uint8_t is_down(void);
-
-// ASCII code for Escape character
-#define ESCAPE_CHAR 27
 
 /////////////////////////////// main //////////////////////////////////
 int main(void) {
@@ -63,18 +68,34 @@ void initialise_hardware(void) {
 	ledmatrix_setup();
 	init_button_interrupts();
 	
-	// Setup serial port for 19200 baud communication with no echo
-	// of incoming characters
-	init_serial_stdio(19200,0);
+	// Moving left (button 3) and right (button 0) repeats while the button
+	// is held: after 170ms, then every 50ms
+	set_button_repeat(0, 170, 50);
+	set_button_repeat(3, 170, 50);
+	
+	// Setup serial port for SERIAL_BAUD_RATE (19200 unless set at build
+	// time) communication with no echo of incoming characters
+	init_serial_stdio(SERIAL_BAUD_RATE,0);
+	
+	// Decode the characters received into key presses as they arrive
+	init_keyboard();
+	
+	// Set up the seven segment display (refreshed by the timer 0 
+	// interrupt handler)
+	init_seven_seg();
 	
 	// Set up our main timer to give us an interrupt every millisecond
 	init_timer0();
 	
+	// Set up the buzzer (timer 2 plays queued sounds)
+	init_sound();
+	
+	// Start sampling the joystick (the ADC interrupt handler keeps the
+	// joystick position up to date)
+	init_joystick();
+	
 	// Turn on global interrupts
 	sei();
-	
-	ADMUX = (1<<REFS0);
-	ADCSRA = (1<<ADEN) | (1<<ADPS2) | (1<<ADPS2);
 }
 
 void splash_screen(void) {
@@ -103,9 +124,12 @@ void splash_screen(void) {
 		// display or a button is pushed. We pause for 130ms between each scroll.
 		while(scroll_display()) {
 			_delay_ms(130);
-			if(button_pushed() != -1) {
-				// A button has been pushed
-				return;
+			QueuedInput input;
+			while(get_input(&input)) {
+				if(input.source == INPUT_BUTTON) {
+					// A button has been pushed
+					return;
+				}
 			}
 		}
 		// Message has scrolled off the display. Change colour
@@ -120,41 +144,53 @@ void splash_screen(void) {
 }
 
 void new_game(void) {
+	// Clear the serial terminal. This must happen before the game is 
+	// initialised as that draws the first block.
+	clear_terminal();
+	terminal_board_reset();
+	
+	// Start recording the game. The time the game starts is used to seed
+	// the block generator (and is recorded so the game can be replayed).
+	uint32_t now = get_clock_ticks();
+	init_replay(now, now);
+	
 	// Initialise the game and display
 	init_game();
 	
-	// Clear the serial terminal
-	clear_terminal();
-	
 	// Initialise the score
 	init_score();
 	init_cleared_rows();
 	
-	// Delete any pending button pushes or serial input
-	empty_button_queue();
-	clear_serial_input_buffer();
+	// Delete any pending button pushes or key presses
+	reset_keyboard();
+	empty_input_queue();
 }
 
-void play_game(void) {
-	uint32_t last_drop_time;
-	int8_t button;
-	char serial_input, escape_sequence_char;
-	uint8_t characters_into_escape_sequence = 0;
-	uint8_t paused = 0;
-	uint32_t paused_time = 0;
+// State of the game in progress, shared by the play_game() tasks
+static uint8_t game_over;
+static uint8_t paused;
+static uint8_t displayed_cleared_rows;
+static uint16_t overflows_at_start;	// input queue overflows before the game
+static int8_t drop_task;
 
-	DDRC = 0xFF;
-	DDRD |= 0b10000000; // 7 to output
-	DDRD &= 0b10111111; // 6 to input
-	
-	// I'm putting all the features that need to get kicked off immediately here and not wiped
-	// by new_game
-	move_cursor(3, 3);
-	printf_P(PSTR("Score: %6d"), get_score());
-	move_cursor(3, 6);
-	printf_P(PSTR("Cleared rows: %6d"), get_cleared_rows());
-	print_block_preview();
-	
+// Periods (ms) of the tasks that aren't tied to the game speed
+#define INPUT_PERIOD 1
+#define JOYSTICK_PERIOD 10
+#define TERMINAL_PERIOD 5
+
+// Drop interval (ms) at the start of the game, the amount it is reduced
+// by for each cleared row, and the shortest interval
+#define START_DROP_INTERVAL 600
+#define DROP_INTERVAL_STEP 30
+#define MIN_DROP_INTERVAL 30
+
+// Most input events processed each time handle_input() is run
+#define INPUT_BATCH_SIZE 8
+
+void play_game(void) {
+	// The score, cleared rows and block preview are drawn (along with the
+	// board) by terminal_board_flush() - new_game() marked them as 
+	// changed. The borders of the board are drawn here.
 	
 	// y, startx, endx
 	draw_horizontal_line(4, 30, 30 + BOARD_WIDTH - 1);
@@ -164,215 +200,204 @@ void play_game(void) {
 	draw_vertical_line(30 - 1, 4, 4 + BOARD_ROWS + 1);
 	draw_vertical_line(30 + BOARD_WIDTH, 4, 4 + BOARD_ROWS + 1);
 	
-	// Record the last time a block was dropped as the current time -
-	// this ensures we don't drop a block immediately.
-	last_drop_time = get_clock_ticks();
+	game_over = 0;
+	paused = 0;
+	displayed_cleared_rows = get_cleared_rows();
+	set_seven_seg_value(displayed_cleared_rows);
 	
-	// We play the game forever. If the game is over, we will break out of
-	// this loop. The loop checks for events (button pushes, serial input etc.)
-	// and on a regular basis will drop the falling block down by one row.
-	while(1) {
-		
-		// And everything that needs to be called in the main loop
-		update_seven_segment();
-		convert_joystick();
+	// The game is run by tasks that are called at their own rates. The
+	// block is dropped by one row every drop interval - the first drop is 
+	// a full interval from now.
+	clear_tasks();
+	drop_task = add_task(drop_interval(), drop_block_on_time);
+	add_task(INPUT_PERIOD, handle_input);
+	add_task(JOYSTICK_PERIOD, handle_joystick);
+	add_task(TERMINAL_PERIOD, update_terminal);
+	
+	// We play the game until it is over. Everything happens in the tasks.
+	// When no task is due the CPU sleeps until the next interrupt.
+	reset_idle_time();
+	overflows_at_start = get_input_queue_overflows();
+	while(!game_over) {
+		if(!run_due_tasks()) {
+			sleep_until_task_due();
+		}
+	}
+	clear_tasks();
+	
+	// If we get here the game is over. Finish the game log and make sure
+	// the LED matrix and terminal show the final board before the game 
+	// over screen.
+	finish_replay();
+	while(!terminal_board_flush()) {
+		; // wait for room in the serial output buffer
+	}
+	ledmatrix_flush();
+}
 
-		// Check for input - which could be a button push or serial input.
-		// Serial input may be part of an escape sequence, e.g. ESC [ D
-		// is a left cursor key press. We will be processing each character
-		// independently and can't do anything until we get the third character.
-		// At most one of the following three variables will be set to a value 
-		// other than -1 if input is available.
-		// (We don't initalise button to -1 since button_pushed() will return -1
-		// if no button pushes are waiting to be returned.)
-		// Button pushes take priority over serial input. If there are both then
-		// we'll retrieve the serial input the next time through this loop
-		serial_input = -1;
-		escape_sequence_char = -1;
-		button = button_pushed();
-		
-		if(button == -1) {
-			// No push button was pushed, see if there is any serial input
-			if(serial_input_available()) {
-				// Serial data was available - read the data from standard input
-				serial_input = fgetc(stdin);
-				// Check if the character is part of an escape sequence
-				if(characters_into_escape_sequence == 0 && serial_input == ESCAPE_CHAR) {
-					// We've hit the first character in an escape sequence (escape)
-					characters_into_escape_sequence++;
-					serial_input = -1; // Don't further process this character
-				} else if(characters_into_escape_sequence == 1 && serial_input == '[') {
-					// We've hit the second character in an escape sequence
-					characters_into_escape_sequence++;
-					serial_input = -1; // Don't further process this character
-				} else if(characters_into_escape_sequence == 2) {
-					// Third (and last) character in the escape sequence
-					escape_sequence_char = serial_input;
-					serial_input = -1;  // Don't further process this character - we
-										// deal with it as part of the escape sequence
-					characters_into_escape_sequence = 0;
-				} else {
-					// Character was not part of an escape sequence (or we received
-					// an invalid second character in the sequence). We'll process 
-					// the data in the serial_input variable.
-					characters_into_escape_sequence = 0;
-				}
-			}
+uint16_t drop_interval(void) {
+	// 600ms (0.6 second) less 30ms for every cleared row, but never less
+	// than MIN_DROP_INTERVAL (the subtraction would otherwise go below
+	// zero and wrap round to a very long interval)
+	uint16_t reduction = get_cleared_rows() * DROP_INTERVAL_STEP;
+	if(reduction > START_DROP_INTERVAL - MIN_DROP_INTERVAL) {
+		return MIN_DROP_INTERVAL;
+	}
+	return START_DROP_INTERVAL - reduction;
+}
+
+void drop_block_on_time(void) {
+	// The drop interval has passed since the last time we dropped
+	// a block, so drop it now.
+	perform_action(INPUT_GRAVITY, ACTION_DROP);
+}
+
+void handle_input(void) {
+	QueuedInput input;
+	int8_t action;
+	
+	// Finish any escape sequence that has timed out (key presses are 
+	// added to the input queue as the characters arrive)
+	check_keyboard_timeout();
+	
+	// Process the input that has arrived - button pushes, key presses and
+	// joystick events - in the order it arrived. We process at most 
+	// INPUT_BATCH_SIZE events at a time so the other tasks aren't held up
+	// - any more are processed next time.
+	for(uint8_t i = 0; i < INPUT_BATCH_SIZE && !game_over; i++) {
+		if(!get_input(&input)) {
+			// No input left
+			return;
 		}
 		
-		// Process the input. 
-		if((button==3 || escape_sequence_char=='D' || is_left()) && !paused) {
-			// Attempt to move left
-			(void)attempt_move(MOVE_LEFT);
-		} else if((button==0 || escape_sequence_char=='C' || is_right()) && !paused) {
-			// Attempt to move right
-			(void)attempt_move(MOVE_RIGHT);
-		} else if ((button==2 || escape_sequence_char == 'A' || is_up()) && !paused) {
-			// Attempt to rotate
-			(void)attempt_rotation();
-		} else if ((escape_sequence_char == 'B' || is_down()) && !paused)  {
-			// Attempt to drop block
-			if(!attempt_drop_block_one_row()) {
-				// Drop failed - fix block to board and add new block
-				if(!fix_block_to_board_and_add_new_block()) {
-					break;	// GAME OVER
-				}
-			} 
-			last_drop_time = get_clock_ticks();
-		} else if ((button==1 || serial_input == ' ') && !paused) {
-			// Attempt to drop block from height
-			
-			// Attempt until failure
-			while(attempt_drop_block_one_row()) {}
-			// Drop failed - fix block to board and add new block	
-			if(!fix_block_to_board_and_add_new_block()) {
-				break;	// GAME OVER
-			}
-			
-		} else if(serial_input == 'p' || serial_input == 'P') {
-			// Unimplemented feature - pause/unpause the game until 'p' or 'P' is
-			// pressed again. All other input (buttons, serial etc.) must be ignored.
+		if(input.source == INPUT_SERIAL && 
+				(input.code == 'p' || input.code == 'P')) {
+			// Pause/unpause the game until 'p' or 'P' is pressed again. All 
+			// other input (buttons, serial etc.) is ignored. The drop task
+			// is suspended so the time left until the next drop is kept.
 			if(!paused) { // if running
 				paused = 1; // pause game
-				paused_time = get_clock_ticks(); // log the time it was paused
+				suspend_task(drop_task);
 			}
 			else { // if paused
 				paused = 0; // unpause game
-				last_drop_time += get_clock_ticks() - paused_time;
-				// Shift the last_drop_time forward for the duration it was paused
+				resume_task(drop_task);
 			}
-		} 
-		// else - invalid input or we're part way through an escape sequence -
-		// do nothing
+			continue;
+		}
 		
-		// Check for timer related events here
-		if((get_clock_ticks() >= last_drop_time + (600 - (get_cleared_rows() * 30))) && !paused) {
-			// 600ms (0.6 second) has passed since the last time we dropped
-			// a block, so drop it now.
-			if(!attempt_drop_block_one_row()) {
-				// Drop failed - fix block to board and add new block
-				if(!fix_block_to_board_and_add_new_block()) {
-					break;	// GAME OVER
-				}
-			}
-			last_drop_time = get_clock_ticks();
+		// Work out which game action (if any) the input asks for
+		action = input_action(&input);
+		if(action != -1 && !paused) {
+			perform_action(input.source, action);
 		}
 	}
-	// If we get here the game is over. 
 }
 
-void handle_game_over() {
-	move_cursor(10,14);
-	// Print a message to the terminal. 
-	printf_P(PSTR("GAME OVER"));
-	move_cursor(10,15);
-	printf_P(PSTR("Press a button to start again"));
-	while(button_pushed() == -1) {
-		; // wait until a button has been pushed
+int8_t input_action(const QueuedInput* input) {
+	switch(input->source) {
+		case INPUT_BUTTON:
+			switch(input->code) {
+				case 3: return ACTION_MOVE_LEFT;
+				case 0: return ACTION_MOVE_RIGHT;
+				case 2: return ACTION_ROTATE;
+				case 1: return ACTION_HARD_DROP;
+			}
+			break;
+		case INPUT_SERIAL:
+			switch(input->code) {
+				case KEY_LEFT: return ACTION_MOVE_LEFT;
+				case KEY_RIGHT: return ACTION_MOVE_RIGHT;
+				case KEY_UP: return ACTION_ROTATE;
+				case KEY_DOWN: return ACTION_DROP;
+				case ' ': return ACTION_HARD_DROP;
+			}
+			break;
+		case INPUT_JOYSTICK:
+			switch(input->code) {
+				case JOYSTICK_LEFT: return ACTION_MOVE_LEFT;
+				case JOYSTICK_RIGHT: return ACTION_MOVE_RIGHT;
+				case JOYSTICK_UP: return ACTION_ROTATE;
+				case JOYSTICK_DOWN: return ACTION_DROP;
+			}
+			break;
 	}
-	
+	return -1;
 }
 
-volatile uint8_t seven_seg_cc = 0;
-uint8_t seven_seg_digits[10] = {63, 6, 91, 79, 102, 109, 125, 7, 127, 111};
-
-void update_seven_segment(void) {
-	
-	seven_seg_cc = 1 ^ seven_seg_cc;
-	
-	if(seven_seg_cc == 0) {
-		PORTC = seven_seg_digits[get_cleared_rows() % 10];
-	} else {
-		PORTC = seven_seg_digits[(get_cleared_rows() / 10) % 10] | 0x80;
+void handle_joystick(void) {
+	// Add any joystick event to the input queue (it is processed by 
+	// handle_input() in order with the other input)
+	int8_t event = joystick_event();
+	if(event != -1) {
+		queue_input(INPUT_JOYSTICK, event, get_task_time());
 	}
 }
 
-uint32_t joystick_time = 0;
-uint8_t target_pin = 0; // the pin we're converting
-uint16_t stick_x = 500; // Pin0
-uint16_t stick_y = 500; // Pin1
+void update_terminal(void) {
+	// Send the recorded game events, then the board rows which have 
+	// changed, to the terminal if there is room in the serial output 
+	// buffer (otherwise they are sent next time, as they are then) - the
+	// game never waits for the terminal
+	if(replay_flush()) {
+		terminal_board_flush();
+	}
+}
 
-void convert_joystick(void) {
-	
-	if (target_pin == 0) {
-		ADMUX = (1 << REFS0) | (0 << MUX0);
-	} 
-	else {
-		ADMUX = (1 << REFS0) | (1 << MUX0);
+void perform_action(uint8_t source, uint8_t action) {
+	// Record where the input came from and perform the action
+	record_input_event(get_task_time(), source, action);
+	if(!perform_game_action(action)) {
+		game_over = 1;
+		return;
 	}
-	
-	ADCSRA |= (1<<ADSC);
-	
-	while (ADCSRA & (1 < ADSC)) {
-		; // repeat until converted
+	if(action == ACTION_DROP) {
+		// The block has just dropped, so the next drop is a full 
+		// interval from now
+		restart_task(drop_task);
 	}
 	
-	if (target_pin == 0) {
-		stick_x = ADC;
+	// Show the number of cleared rows on the seven segment display
+	// (the display itself is refreshed by the timer 0 interrupt handler)
+	// and speed up the drops if rows have been cleared
+	if(get_cleared_rows() != displayed_cleared_rows) {
+		displayed_cleared_rows = get_cleared_rows();
+		set_seven_seg_value(displayed_cleared_rows);
+		set_task_period(drop_task, drop_interval());
 	}
-	else {
-		stick_y = ADC;
-	}
-
-	target_pin = !target_pin; // do the other pin next time
 }
 
-uint8_t is_left(void) { // time is at least 150 ticks later than the last joystick input
-	if ((stick_x > 850) && (get_clock_ticks() > joystick_time + 150)) {
-		joystick_time = get_clock_ticks(); 
-		return 1;
-	}
-	else {
-		return 0;
-	}
-}
+// Terminal column of the game over messages - to the right of the board 
+// (and its border) so the final board stays visible
+#define GAME_OVER_X (TERMINAL_BOARD_X + BOARD_WIDTH + 4)
 
-uint8_t is_right(void) {
-	if ((stick_x < 150) && (get_clock_ticks() > joystick_time + 150)) {
-		joystick_time = get_clock_ticks();
-		return 1;
-	}
-	else {
-		return 0;
+void handle_game_over() {
+	move_cursor(GAME_OVER_X,14);
+	// Print a message to the terminal. 
+	printf_P(PSTR("GAME OVER"));
+	move_cursor(GAME_OVER_X,15);
+	printf_P(PSTR("Press a button to start again"));
+	move_cursor(GAME_OVER_X,18);
+	printf_P(PSTR("CPU idle during game: %3d%%"), get_idle_percentage());
+	move_cursor(GAME_OVER_X,19);
+	printf_P(PSTR("Input events lost: %u"), 
+			get_input_queue_overflows() - overflows_at_start);
+	
+	// A button may still be held from the game (and be autorepeating), 
+	// so only a button pushed after they have all been released starts 
+	// a new game. Anything already queued is ignored.
+	while(buttons_held()) {
+		; // wait
 	}
-}
-
-uint8_t is_up(void) { 
-	if ((stick_y > 850) && (get_clock_ticks() > joystick_time + 300)) {
-		joystick_time = get_clock_ticks(); 
-		return 1;
-	} 
-	else {
-		return 0;
+	empty_input_queue();
+	
+	QueuedInput input;
+	while(1) {
+		// wait until a button has been pushed
+		check_keyboard_timeout();
+		if(get_input(&input) && input.source == INPUT_BUTTON) {
+			break;
+		}
 	}
+	
 }
-
-uint8_t is_down(void) { 
-	if ((stick_y < 150) && (get_clock_ticks() > joystick_time + 150)) {
-		joystick_time = get_clock_ticks(); 
-		return 1;
-	} 
-	else {
-		return 0;
-	}
-}
\ No newline at end of file
@@ -0,0 +1,98 @@
+/*
+ * replay.c
+ *
+ * Author: Max Bo
+ *
+ * The log isn't kept on the board - there isn't room for a whole game.
+ * Instead each record is sent to the terminal as it happens, inside an 
+ * APC (application program command) escape sequence - ESC _ ... ESC \ - 
+ * which terminals don't display. A capture of the terminal output holds
+ * the log of the whole game.
+ * Events are queued here and sent by replay_flush() when there is room in
+ * the serial output buffer, so recording an event never waits for the 
+ * terminal. Ticks are sent relative to the start of the game.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+#include "replay.h"
+#include "blocks.h"
+#include "game.h"
+#include "score.h"
+#include "serialio.h"
+
+/* Events waiting to be sent. The queue indices run freely from 0 to 255 
+ * and the position in the queue is the index masked by (size - 1), so the
+ * size must be a power of 2 (no larger than 128). 
+ */
+#define REPLAY_QUEUE_SIZE 16
+#define REPLAY_QUEUE_MASK (REPLAY_QUEUE_SIZE - 1)
+
+/* Most characters sent for an event: ESC _ <tick> <source> <action> ESC \ */
+#define EVENT_MAX_CHARS 20
+
+typedef struct {
+	uint32_t tick;
+	uint8_t source_and_action;	// source in the high nibble
+} QueuedEvent;
+
+static QueuedEvent event_queue[REPLAY_QUEUE_SIZE];
+static uint8_t queue_head;
+static uint8_t queue_tail;
+
+static uint32_t start_tick;
+static uint32_t events_recorded;
+static uint16_t events_lost;
+
+void init_replay(uint32_t seed, uint32_t tick) {
+	start_tick = tick;
+	queue_head = 0;
+	queue_tail = 0;
+	events_recorded = 0;
+	events_lost = 0;
+	init_block_generator(seed);
+	printf_P(PSTR("\x1b_REPLAY %lu\x1b\\"), (unsigned long)seed);
+}
+
+void record_input_event(uint32_t tick, uint8_t source, uint8_t action) {
+	if((uint8_t)(queue_head - queue_tail) >= REPLAY_QUEUE_SIZE) {
+		// The terminal has fallen too far behind - the log can't be
+		// replayed now, but we note how much was lost
+		events_lost++;
+		return;
+	}
+	QueuedEvent* event = &event_queue[queue_head & REPLAY_QUEUE_MASK];
+	event->tick = tick - start_tick;
+	event->source_and_action = (source << 4) | action;
+	queue_head++;
+	events_recorded++;
+}
+
+uint8_t replay_flush(void) {
+	while(queue_tail != queue_head) {
+		if(serial_output_space() < EVENT_MAX_CHARS) {
+			// No room - try again later
+			return 0;
+		}
+		QueuedEvent* event = &event_queue[queue_tail & REPLAY_QUEUE_MASK];
+		printf_P(PSTR("\x1b_%lu %u %u\x1b\\"), (unsigned long)event->tick,
+				event->source_and_action >> 4, 
+				event->source_and_action & 0x0F);
+		queue_tail++;
+	}
+	return 1;
+}
+
+void finish_replay(void) {
+	while(!replay_flush()) {
+		; // wait for room in the serial output buffer
+	}
+	if(events_lost) {
+		printf_P(PSTR("\x1b_LOST %u\x1b\\"), events_lost);
+	}
+	printf_P(PSTR("\x1b_END %lu %lu %lu %u\x1b\\"), 
+			(unsigned long)events_recorded, (unsigned long)get_board_hash(),
+			(unsigned long)get_score(), get_cleared_rows());
+}
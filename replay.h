@@ -0,0 +1,51 @@
+/*
+ * replay.h
+ *
+ * Author: Max Bo
+ *
+ * Recording of games so that they can be replayed (see host/replay.c).
+ * A game is completely determined by the seed used for the block
+ * generator and the sequence of game actions (see game.h) performed, so
+ * that is what we record. Each recorded event also notes the time (clock 
+ * tick) and where the input came from, to help work out what happened.
+ * The log is sent to the terminal as the game is played, as records in 
+ * the format read by the replay runner:
+ *	REPLAY <seed>
+ *	<tick> <source> <action>		(one per event)
+ *	LOST <events>					(only if events were lost)
+ *	END <events> <board hash> <score> <cleared rows>
+ * Each record is inside ESC _ ... ESC \ so the terminal doesn't display
+ * it. To replay a game, capture the terminal output (e.g. with the 
+ * terminal program's logging) and give the capture to the runner.
+ */
+
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <stdint.h>
+#include "input_queue.h"	// Input sources
+
+/* Start recording a new game which starts at the given clock tick. The
+ * block generator is seeded with the given seed. Must be called before 
+ * the game is initialised.
+ */
+void init_replay(uint32_t seed, uint32_t tick);
+
+/* Record a game action. tick is the current clock tick. The event is
+ * queued to be sent to the terminal by replay_flush(). If the queue is 
+ * full the event is lost (and counted).
+ */
+void record_input_event(uint32_t tick, uint8_t source, uint8_t action);
+
+/* Send the queued events to the terminal, as long as there is room for
+ * each one in the serial output buffer. Returns 1 if all the events have
+ * been sent, 0 if some are still waiting.
+ */
+uint8_t replay_flush(void);
+
+/* Send any events still queued (waiting for room if necessary) followed by
+ * the results of the game. Called when the game is over.
+ */
+void finish_replay(void);
+
+#endif /* REPLAY_H_ */
@@ -25,8 +25,7 @@ void set_scrolling_display_text(char* string, PixelColour colour);
 /* Scroll the display. Should be called whenever the display
  * is to be scrolled one pixel to the left. It is recommended that
  * this function NOT be called from an interrupt service routine as
- * it will wait for SPI communication to be finished before returning. 
- * This could take over 1ms.
+ * it may have to wait for space in the SPI output queue (see spi.h).
  * Returns 1 while a message is still scrolling, 0 when done.
  */
 uint8_t scroll_display(void);
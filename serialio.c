@@ -22,39 +22,86 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "serialio.h"
 
 /* System clock rate in Hz. (L at the end indicates this is a long constant) */
 #define SYSCLK 8000000L
 
 /* Global variables */
-/* Circular buffer to hold outgoing characters. The insert_pos variable
- * keeps track of the position (0 to OUTPUT_BUFFER_SIZE-1) that the next
- * outgoing character should be written to. bytes_in_buffer keeps
- * count of the number of characters currently stored in the buffer 
- * (ranging from 0 to OUTPUT_BUFFER_SIZE). This number of bytes immediately
- * prior to the current insert_pos are the bytes waiting to be output.
- * If the insert_pos reaches the end of the buffer it will wrap around
- * to the beginning (assuming those bytes have been output).
- * NOTE - OUTPUT_BUFFER_SIZE can not be larger than 255 without changing
- * the type of the variables below.
+/* Circular buffers for outgoing and incoming characters. Each buffer 
+ * has a head index - where the next character is written - and a tail
+ * index - where the next character is read from. The indices run 
+ * freely from 0 to 255 and wrap around; the position in the buffer is
+ * the index masked by (size - 1), so the sizes must be powers of two. The
+ * number of characters in a buffer is head - tail (a byte), so the input
+ * buffer can't be larger than 128. The output buffer can have 256 
+ * entries (the indices then wrap around at the end of the buffer) but 
+ * only 255 of them are used so that a full buffer doesn't look empty.
+ * Only one side writes each index: for the output buffer the main 
+ * program writes head and the UDR empty interrupt handler writes tail,
+ * for the input buffer the receive interrupt handler writes head and 
+ * the main program writes tail. An index is a single byte so it is 
+ * always read and written in one go - neither side has to disable
+ * interrupts. A character is written before head is advanced past it, 
+ * so the reading side never sees a position before it holds a 
+ * character. 
+ * The sizes can be overridden at build time.
  */
-#define OUTPUT_BUFFER_SIZE 255
-volatile char out_buffer[OUTPUT_BUFFER_SIZE];
-volatile uint8_t out_insert_pos;
-volatile uint8_t bytes_in_out_buffer;
+#ifndef SERIAL_OUTPUT_BUFFER_SIZE
+#define SERIAL_OUTPUT_BUFFER_SIZE 256
+#endif
+#ifndef SERIAL_INPUT_BUFFER_SIZE
+#define SERIAL_INPUT_BUFFER_SIZE 16
+#endif
 
-/* Circular buffer to hold incoming characters. Works on same principle
- * as output buffer
- */
-#define INPUT_BUFFER_SIZE 16
-volatile char input_buffer[INPUT_BUFFER_SIZE];
-volatile uint8_t input_insert_pos;
-volatile uint8_t bytes_in_input_buffer;
+#if (SERIAL_OUTPUT_BUFFER_SIZE & (SERIAL_OUTPUT_BUFFER_SIZE - 1)) != 0 || \
+		SERIAL_OUTPUT_BUFFER_SIZE > 256
+#error SERIAL_OUTPUT_BUFFER_SIZE must be a power of 2 no larger than 256
+#endif
+#if (SERIAL_INPUT_BUFFER_SIZE & (SERIAL_INPUT_BUFFER_SIZE - 1)) != 0 || \
+		SERIAL_INPUT_BUFFER_SIZE > 128
+#error SERIAL_INPUT_BUFFER_SIZE must be a power of 2 no larger than 128
+#endif
+
+#define OUTPUT_BUFFER_MASK (SERIAL_OUTPUT_BUFFER_SIZE - 1)
+#if SERIAL_OUTPUT_BUFFER_SIZE == 256
+#define OUTPUT_BUFFER_CAPACITY 255
+#else
+#define OUTPUT_BUFFER_CAPACITY SERIAL_OUTPUT_BUFFER_SIZE
+#endif
+#define INPUT_BUFFER_MASK (SERIAL_INPUT_BUFFER_SIZE - 1)
+
+volatile char out_buffer[SERIAL_OUTPUT_BUFFER_SIZE];
+volatile uint8_t out_head;
+volatile uint8_t out_tail;
+
+volatile char input_buffer[SERIAL_INPUT_BUFFER_SIZE];
+volatile uint8_t input_head;
+volatile uint8_t input_tail;
 volatile uint8_t input_overrun;
 
+/* If set, the function each received character is passed to (rather 
+ * than being put in the input buffer)
+ */
+static volatile SerialInputHandler input_handler;
+
+#if SERIAL_XON_XOFF
+/* Flow control characters, and whether output has been stopped by XOFF */
+#define XON 0x11
+#define XOFF 0x13
+static volatile uint8_t output_stopped;
+#endif
+
+/* Baud rate error (tenths of a percent) */
+static int16_t baud_error;
+
 /* Variable to keep track of whether incoming characters are to be echoed
  * back or not.
  */
@@ -65,6 +112,11 @@ static int8_t do_echo;
 void init_serial_stdio(long baudrate, int8_t echo);
 static int uart_put_char(char, FILE*);
 static int uart_get_char(FILE*);
+static void write_to_buffer(const char* data, uint8_t length, 
+		uint8_t in_program_memory);
+static uint16_t baud_rate_register(long baudrate, uint8_t divider);
+static int16_t baud_rate_error(long baudrate, uint16_t ubrr, 
+		uint8_t divider);
 
 /* Setup a stream that uses the uart get and put functions. We will
  * make standard input and output use this stream below.
@@ -73,28 +125,44 @@ static FILE myStream = FDEV_SETUP_STREAM(uart_put_char, uart_get_char,
 		_FDEV_SETUP_RW);
 
 void init_serial_stdio(long baudrate, int8_t echo) {
-	uint16_t ubrr;
+	uint16_t ubrr, double_speed_ubrr;
+	int16_t double_speed_error;
 	/*
 	 * Initialise our buffers
 	*/
-	out_insert_pos = 0;
-	bytes_in_out_buffer = 0;
-	input_insert_pos = 0;
-	bytes_in_input_buffer = 0;
+	out_head = 0;
+	out_tail = 0;
+	input_head = 0;
+	input_tail = 0;
 	input_overrun = 0;
+	input_handler = NULL;
+#if SERIAL_XON_XOFF
+	output_stopped = 0;
+#endif
 	
 	/*
-	 * Record whether we're going to echo characters or not
+	 * Record whether we're going to echo characters or not (characters
+	 * are echoed as they are read)
 	*/
 	do_echo = echo;
 	
-	/* Configure the serial port baud rate */
-	/* (This differs from the datasheet formula so that we get 
-	 * rounding to the nearest integer while using integer division
-	 * (which truncates)).
+	/* Configure the serial port baud rate. The UART clock is the 
+	 * system clock divided by 16 - or by 8 in double speed mode. We 
+	 * use whichever gives the rate closest to the one asked for
+	 * (preferring normal speed, which is more tolerant of noise).
 	*/
-	ubrr = ((SYSCLK / (8 * baudrate)) + 1)/2 - 1;
-	UBRR0 = ubrr;
+	ubrr = baud_rate_register(baudrate, 16);
+	baud_error = baud_rate_error(baudrate, ubrr, 16);
+	double_speed_ubrr = baud_rate_register(baudrate, 8);
+	double_speed_error = baud_rate_error(baudrate, double_speed_ubrr, 8);
+	if(abs(double_speed_error) < abs(baud_error)) {
+		UCSR0A = (1<<U2X0);
+		UBRR0 = double_speed_ubrr;
+		baud_error = double_speed_error;
+	} else {
+		UCSR0A = 0;
+		UBRR0 = ubrr;
+	}
 	
 	/*
 	 * Enable transmission and receiving via UART. We don't enable
@@ -118,97 +186,156 @@ void init_serial_stdio(long baudrate, int8_t echo) {
 	stdin = &myStream;
 }
 
+int16_t get_serial_baud_error(void) {
+	return baud_error;
+}
+
+/*
+ * Return the baud rate register value for the given baud rate when the
+ * system clock is divided by divider (16 or 8).
+ * (This differs from the datasheet formula so that we get rounding to 
+ * the nearest integer while using integer division (which truncates)).
+ */
+static uint16_t baud_rate_register(long baudrate, uint8_t divider) {
+	uint16_t ubrr = ((SYSCLK / ((divider / 2) * baudrate)) + 1)/2;
+	return (ubrr > 0) ? ubrr - 1 : 0;
+}
+
+/*
+ * Return the error (tenths of a percent) in the baud rate given by the 
+ * baud rate register value ubrr.
+ */
+static int16_t baud_rate_error(long baudrate, uint16_t ubrr, 
+		uint8_t divider) {
+	long actual = SYSCLK / (divider * (ubrr + 1L));
+	return ((actual - baudrate) * 1000) / baudrate;
+}
+
+uint8_t serial_output_space(void) {
+	return OUTPUT_BUFFER_CAPACITY - (uint8_t)(out_head - out_tail);
+}
+
+void set_serial_input_handler(SerialInputHandler handler) {
+	/* The pointer is two bytes so we make sure the interrupt handler 
+	 * doesn't see it half changed
+	 */
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	input_handler = handler;
+	if(interrupts_were_on) {
+		sei();
+	}
+}
+
 int8_t serial_input_available(void) {
-	return (bytes_in_input_buffer != 0);
+	return (input_head != input_tail);
 }
 
 void clear_serial_input_buffer(void) {
-	/* Just adjust our buffer data so it looks empty */
-	input_insert_pos = 0;
-	bytes_in_input_buffer = 0;
+	/* Just skip over everything in the buffer */
+	input_tail = input_head;
 }
 
 static int uart_put_char(char c, FILE* stream) {
-	uint8_t interrupts_enabled;
-	
-	/* Add the character to the buffer for transmission (if there 
-	 * is space to do so). If not we wait until the buffer has space.
-	 * If the character is \n, we output \r (carriage return)
-	 * also.
-	*/
+	/* Add the character to the buffer for transmission. If the 
+	 * character is \n, we output \r (carriage return) also.
+	 */
 	if(c == '\n') {
-		uart_put_char('\r', stream);
-	}
-	
-	/* If the buffer is full and interrupts are disabled then we
-	 * abort - we don't output the character since the buffer will
-	 * never be emptied if interrupts are disabled. If the buffer is full
-	 * and interrupts are enabled then we loop until the buffer has 
-	 * enough space. The bytes_in_buffer variable will get modified by the
-	 * ISR which extracts bytes from the buffer.
-	*/
-	interrupts_enabled = bit_is_set(SREG, SREG_I);
-	while(bytes_in_out_buffer >= OUTPUT_BUFFER_SIZE) {
-		if(!interrupts_enabled) {
-			return 1;
-		}		
-		/* else do nothing */
+		write_to_buffer("\r\n", 2, 0);
+	} else {
+		write_to_buffer(&c, 1, 0);
 	}
+	return 0;
+}
+
+void serial_write(const char* data, uint8_t length) {
+	write_to_buffer(data, length, 0);
+}
+
+void serial_write_P(const char* data, uint8_t length) {
+	write_to_buffer(data, length, 1);
+}
+
+/*
+ * Add length bytes from data (in program memory or RAM) to the output 
+ * buffer.
+ */
+static void write_to_buffer(const char* data, uint8_t length, 
+		uint8_t in_program_memory) {
+	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
 	
-	/* Add the character to the buffer for transmission if there
-	 * is space to do so. We advance the insert_pos to the next
-	 * character position. If this is beyond the end of the buffer
-	 * we wrap around back to the beginning of the buffer 
-	 * NOTE: we disable interrupts before modifying the buffer. This
-	 * prevents the ISR from modifying the buffer at the same time.
-	 * We reenable them if they were enabled when we entered the
-	 * function.
-	*/	
-	cli();
-	out_buffer[out_insert_pos++] = c;
-	bytes_in_out_buffer++;
-	if(out_insert_pos == OUTPUT_BUFFER_SIZE) {
-		/* Wrap around buffer pointer if necessary */
-		out_insert_pos = 0;
-	}
-	/* Reenable interrupts (UDR Empty interrupt may have been
-	 * disabled) */
-	UCSR0B |= (1 << UDRIE0);
-	if(interrupts_enabled) {
-		sei();
+	while(length > 0) {
+		/* Write as much as will fit in an empty buffer at a time */
+		uint8_t part_length = length;
+#if OUTPUT_BUFFER_CAPACITY < 255
+		if(part_length > OUTPUT_BUFFER_CAPACITY) {
+			part_length = OUTPUT_BUFFER_CAPACITY;
+		}
+#endif
+		
+		/* If there isn't space for the bytes and interrupts are 
+		 * disabled then we abort - we don't output the bytes since the
+		 * buffer will never be emptied if interrupts are disabled. If
+		 * interrupts are enabled then we loop until the buffer has 
+		 * enough space. out_tail will get modified by the ISR which
+		 * extracts bytes from the buffer.
+		 */
+		while((uint8_t)(OUTPUT_BUFFER_CAPACITY - 
+				(uint8_t)(out_head - out_tail)) < part_length) {
+			if(!interrupts_enabled) {
+				return;
+			}
+			/* else do nothing */
+		}
+		
+		/* Copy the bytes to the buffer at the head - in two parts if
+		 * they wrap around the end of the buffer - and then advance
+		 * the head past them. 
+		 */
+		uint8_t position = out_head & OUTPUT_BUFFER_MASK;
+		uint16_t space_to_end = SERIAL_OUTPUT_BUFFER_SIZE - position;
+		uint8_t first_part = 
+				(part_length < space_to_end) ? part_length : space_to_end;
+		char* destination = (char*)out_buffer + position;
+		if(in_program_memory) {
+			memcpy_P(destination, data, first_part);
+			memcpy_P((char*)out_buffer, data + first_part, 
+					part_length - first_part);
+		} else {
+			memcpy(destination, data, first_part);
+			memcpy((char*)out_buffer, data + first_part, 
+					part_length - first_part);
+		}
+		/* (The memory barrier makes sure the compiler doesn't move 
+		 * the copy after the head update.)
+		 */
+		__asm__ __volatile__("" ::: "memory");
+		out_head += part_length;
+		data += part_length;
+		length -= part_length;
+		
+		/* Make sure the UDR Empty interrupt is enabled (it is disabled
+		 * when the buffer empties). The interrupt handler only disables 
+		 * it when the buffer is empty, which it can't be now.
+		 */
+		UCSR0B |= (1 << UDRIE0);
 	}
-	return 0;
 }
 
 int uart_get_char(FILE* stream) {
 	/* Wait until we've received a character */
-	while(bytes_in_input_buffer == 0) {
+	while(input_head == input_tail) {
 		/* do nothing */
 	}
 	
-	/*
-	 * Turn interrupts off and remove a character from the input
-	 * buffer. We reenable interrupts if they were on.
-	 * The pending character is the one which is byte_in_input_buffer
-	 * characters before the insert position (taking into account
-	 * that we may need to wrap around).
-	 */
-	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
-	cli();
-	char c;
-	if(input_insert_pos - bytes_in_input_buffer < 0) {
-		/* Need to wrap around */
-		c = input_buffer[input_insert_pos - bytes_in_input_buffer
-				+ INPUT_BUFFER_SIZE];
-	} else {
-		c = input_buffer[input_insert_pos - bytes_in_input_buffer];
-	}
+	/* Remove the character at the tail of the input buffer */
+	char c = input_buffer[input_tail & INPUT_BUFFER_MASK];
+	input_tail++;
 	
-	/* Decrement our count of bytes in the input buffer */
-	bytes_in_input_buffer--;
-	if(interrupts_enabled) {
-		sei();
-	}	
+	if(do_echo) {
+		/* Echo the character back to the UART */
+		uart_put_char(c, stream);
+	}
 	return c;
 }
 
@@ -218,35 +345,21 @@ int uart_get_char(FILE* stream) {
  */
 ISR(USART0_UDRE_vect) 
 {
-	/* Check if we have data in our buffer */
-	if(bytes_in_out_buffer > 0) {
-		/* Yes we do - remove the pending byte and output it
-		 * via the UART. The pending byte (character) is the
-		 * one which is "bytes_in_buffer" characters before the 
-		 * insert_pos (taking into account that we may 
-		 * need to wrap around to the end of the buffer).
-		 */
-		char c;
-		if(out_insert_pos - bytes_in_out_buffer < 0) {
-			/* Need to wrap around */
-			c = out_buffer[out_insert_pos - bytes_in_out_buffer
-				+ OUTPUT_BUFFER_SIZE];
-		} else {
-			c = out_buffer[out_insert_pos - bytes_in_out_buffer];
-		}
-		/* Decrement our count of the number of bytes in the 
-		 * buffer 
-		 */
-		bytes_in_out_buffer--;
-		
-		/* Output the character via the UART */
-		UDR0 = c;
+	uint8_t tail = out_tail;
+#if SERIAL_XON_XOFF
+	if(tail != out_head && !output_stopped) {
+#else
+	if(tail != out_head) {
+#endif
+		/* Output the byte at the tail and remove it from the buffer */
+		UDR0 = out_buffer[tail & OUTPUT_BUFFER_MASK];
+		out_tail = tail + 1;
 	} else {
-		/* No data in the buffer. We disable the UART Data
-		 * Register Empty interrupt because otherwise it 
-		 * will trigger again immediately this ISR exits. 
-		 * The interrupt is reenabled when a character is
-		 * placed in the buffer.
+		/* No data in the buffer (or output is stopped). We 
+		 * disable the UART Data Register Empty interrupt because
+		 * otherwise it will trigger again immediately this ISR 
+		 * exits. The interrupt is reenabled when a character is
+		 * placed in the buffer (or output is restarted).
 		 */
 		UCSR0B &= ~(1<<UDRIE0);
 	}
@@ -263,14 +376,31 @@ ISR(USART0_RX_vect)
 	/* Read the character - we ignore the possibility of overrun. */
 	char c;
 	c = UDR0;
-		
-	if(do_echo && bytes_in_out_buffer < OUTPUT_BUFFER_SIZE) {
-		/* If echoing is enabled and there is output buffer
-		 * space, echo the received character back to the UART.
-		 * (If there is no output buffer space, characters
-		 * will be lost.)
-		 */
-		uart_put_char(c, 0);
+	
+#if SERIAL_XON_XOFF
+	/* Stop or restart output if this is a flow control character */
+	if(c == XOFF) {
+		output_stopped = 1;
+		return;
+	} else if(c == XON) {
+		output_stopped = 0;
+		UCSR0B |= (1 << UDRIE0);
+		return;
+	}
+#endif
+	
+	/* If the character is a carriage return, turn it into a
+	 * linefeed 
+	*/
+	if (c == '\r') {
+		c = '\n';
+	}
+	
+	/* Pass the character on straight away if we have a handler for it */
+	SerialInputHandler handler = input_handler;
+	if(handler) {
+		handler(c);
+		return;
 	}
 	
 	/* 
@@ -279,24 +409,14 @@ ISR(USART0_RX_vect)
 	 * overrun flag - it's up to the programmer to check/clear
 	 * this flag if desired.)
 	 */
-	if(bytes_in_input_buffer >= INPUT_BUFFER_SIZE) {
+	uint8_t head = input_head;
+	if((uint8_t)(head - input_tail) >= SERIAL_INPUT_BUFFER_SIZE) {
 		input_overrun = 1;
 	} else {
-		/* If the character is a carriage return, turn it into a
-		 * linefeed 
-		*/
-		if (c == '\r') {
-			c = '\n';
-		}
-		
 		/* 
 		 * There is room in the input buffer 
 		 */
-		input_buffer[input_insert_pos++] = c;
-		bytes_in_input_buffer++;
-		if(input_insert_pos == INPUT_BUFFER_SIZE) {
-			/* Wrap around buffer pointer if necessary */
-			input_insert_pos = 0;
-		}
+		input_buffer[head & INPUT_BUFFER_MASK] = c;
+		input_head = head + 1;
 	}
 }
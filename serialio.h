@@ -18,13 +18,73 @@
 
 #include <stdint.h>
 
+/* Baud rate used for the terminal. The UART clock divider (normal or 
+ * double speed, U2X) which gives the smallest baud rate error is chosen.
+ * With the 8MHz clock the errors are:
+ *		Baud rate	Normal		Double speed	Used
+ *		19200		+0.2%		+0.2%			normal
+ *		38400		+0.2%		+0.2%			normal
+ *		57600		-3.5%		+2.1%			double speed
+ *		115200		+8.5%		-3.5%			double speed
+ *		250000		0%			0%				normal
+ * 115200 is outside the +/-2% that most receivers tolerate - 250000 is 
+ * the fastest reliable rate (if the serial adapter supports it).
+ */
+#ifndef SERIAL_BAUD_RATE
+#define SERIAL_BAUD_RATE 19200
+#endif
+
+/* If SERIAL_XON_XOFF is non-zero, output is stopped when an XOFF 
+ * character (Ctrl-S) is received and restarted when XON (Ctrl-Q) is 
+ * received, so the terminal can throttle us. The XON and XOFF characters
+ * are not passed on as input.
+ */
+#ifndef SERIAL_XON_XOFF
+#define SERIAL_XON_XOFF 0
+#endif
+
 /* Initialise serial IO using the UART. baudrate specifies the desired
  * baudrate (e.g. 19200) and echo determines whether incoming characters
- * are echoed back to the UART output as they are received (zero means no
+ * are echoed back to the UART output as they are read (zero means no
  * echo, non-zero means echo)
  */
 void init_serial_stdio(long baudrate, int8_t echo);
 
+/* Return the difference between the actual and requested baud rate, in
+ * tenths of a percent.
+ */
+int16_t get_serial_baud_error(void);
+
+/* Write length bytes to the serial port. Unlike the standard IO functions
+ * no translation is done (a \n is not followed by \r). The bytes are 
+ * added to the output buffer together (in parts the size of the buffer
+ * if there are more). If there is not enough space in the buffer we wait
+ * for it, or if interrupts are disabled, discard the bytes.
+ */
+void serial_write(const char* data, uint8_t length);
+
+/* As serial_write(), but the bytes are in program memory.
+ */
+void serial_write_P(const char* data, uint8_t length);
+
+/* Return the number of bytes that can be written without waiting for
+ * space in the output buffer.
+ */
+uint8_t serial_output_space(void);
+
+/* Function called with each character received when input is handled
+ * as it arrives (see below).
+ */
+typedef void (*SerialInputHandler)(char c);
+
+/* Have each character received passed to handler as soon as it arrives
+ * (carriage returns are passed on as linefeeds) instead of being put in
+ * the input buffer to be read from stdin. The handler is called from the
+ * receive interrupt handler so it must be short. A NULL handler goes 
+ * back to buffering input.
+ */
+void set_serial_input_handler(SerialInputHandler handler);
+
 /* Test if input is available from the serial port. Return 0 if not,
  * non-zero otherwise.
  */
@@ -0,0 +1,49 @@
+/*
+ * seven_seg.c
+ *
+ * Author: Max Bo
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "seven_seg.h"
+
+// Digit select bit (set for the tens digit)
+#define SEVEN_SEG_CC 0x80
+
+// Segment values for the digits 0 to 9
+static const uint8_t seven_seg_digits[10] PROGMEM = {
+		63, 6, 91, 79, 102, 109, 125, 7, 127, 111};
+
+// Port C values for the ones and tens digits, and which one is displayed
+static volatile uint8_t seven_seg_buffer[2];
+static uint8_t seven_seg_cc;
+
+void init_seven_seg(void) {
+	DDRC = 0xFF;
+	seven_seg_cc = 0;
+	set_seven_seg_value(0);
+}
+
+void set_seven_seg_value(uint8_t value) {
+	uint8_t ones = pgm_read_byte(&seven_seg_digits[value % 10]);
+	uint8_t tens = pgm_read_byte(&seven_seg_digits[(value / 10) % 10]) |
+			SEVEN_SEG_CC;
+	
+	// Update both digits together so the display never shows half of 
+	// the old value and half of the new
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	seven_seg_buffer[0] = ones;
+	seven_seg_buffer[1] = tens;
+	if(interrupts_were_on) {
+		sei();
+	}
+}
+
+void refresh_seven_seg(void) {
+	seven_seg_cc = 1 ^ seven_seg_cc;
+	PORTC = seven_seg_buffer[seven_seg_cc];
+}
@@ -0,0 +1,31 @@
+/*
+ * seven_seg.h
+ *
+ * Author: Max Bo
+ *
+ * Two digit seven segment display. The segments are connected to pins
+ * C0 to C6 and the digit select (CC) line to pin C7. Only one digit can be
+ * lit at a time, so the timer 0 interrupt handler calls 
+ * refresh_seven_seg() every millisecond to alternate between them. The
+ * segment values for both digits are worked out when the value is set so
+ * the refresh only has to write them to the port.
+ */
+
+#ifndef SEVEN_SEG_H_
+#define SEVEN_SEG_H_
+
+#include <stdint.h>
+
+/* Set up port C and display 00.
+ */
+void init_seven_seg(void);
+
+/* Set the value (0 to 99) to be displayed.
+ */
+void set_seven_seg_value(uint8_t value);
+
+/* Display the next digit. Called from the timer 0 interrupt handler.
+ */
+void refresh_seven_seg(void);
+
+#endif /* SEVEN_SEG_H_ */
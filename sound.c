@@ -0,0 +1,150 @@
+/*
+ * sound.c
+ *
+ * Author: Max Bo
+ *
+ * Timer 2 is run in CTC mode with the clock divided by 128 (i.e. one count
+ * every 16us with an 8MHz clock). Each compare match toggles the buzzer
+ * pin, so the output compare value sets the pitch and the number of
+ * toggles sets the length of the sound. When a sound finishes, the
+ * interrupt handler starts the next queued sound or stops the timer.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "sound.h"
+
+#define SPEAKER_PIN 7
+#define MUTE_PIN 6
+
+/* The sounds we can play. half_period is the number of timer counts 
+ * (16us each) between toggles of the buzzer pin and toggles is the
+ * number of toggles (2 per cycle).
+ */
+typedef struct {
+	uint8_t half_period;
+	uint8_t toggles;
+} Note;
+
+#define SOUND_HIGH 0
+#define SOUND_MEDIUM 1
+#define SOUND_LOW 2
+
+static const Note notes[] = {
+	{ 16, 72 },		// High - 256us half period, 36 cycles
+	{ 94, 24 },		// Medium - 1.5ms half period, 12 cycles
+	{ 188, 12 }		// Low - 3ms half period, 6 cycles
+};
+
+/* Circular buffer of sounds waiting to be played. Works on the same 
+ * principle as the serial output buffer (see serialio.c). sound_playing is
+ * non-zero while the timer is running.
+ */
+#define SOUND_QUEUE_SIZE 8
+static volatile uint8_t sound_queue[SOUND_QUEUE_SIZE];
+static volatile uint8_t sound_insert_pos;
+static volatile uint8_t sounds_in_queue;
+static volatile uint8_t sound_playing;
+static volatile uint8_t toggles_remaining;
+
+static void queue_sound(uint8_t sound);
+static void start_next_sound(void);
+
+void init_sound(void) {
+	// Buzzer pin is an output (initially low), mute pin is an input
+	DDRD |= (1<<SPEAKER_PIN);
+	DDRD &= ~(1<<MUTE_PIN);
+	PORTD &= ~(1<<SPEAKER_PIN);
+	
+	sound_insert_pos = 0;
+	sounds_in_queue = 0;
+	sound_playing = 0;
+	
+	// CTC mode. The timer is stopped (no clock source) until a sound
+	// is queued.
+	TCCR2A = (1<<WGM21);
+	TCCR2B = 0;
+	
+	// Enable an interrupt on output compare match and make sure the
+	// interrupt flag is cleared (by writing a 1 to it)
+	TIMSK2 |= (1<<OCIE2A);
+	TIFR2 = (1<<OCF2A);
+}
+
+void make_sound_high(void) {
+	queue_sound(SOUND_HIGH);
+}
+
+void make_sound_medium(void) {
+	queue_sound(SOUND_MEDIUM);
+}
+
+void make_sound_low(void) {
+	queue_sound(SOUND_LOW);
+}
+
+static void queue_sound(uint8_t sound) {
+	// Turn off interrupts while we modify the queue. We turn them
+	// back on if they were on.
+	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
+	cli();
+	if(sounds_in_queue < SOUND_QUEUE_SIZE) {
+		sound_queue[sound_insert_pos++] = sound;
+		sounds_in_queue++;
+		if(sound_insert_pos == SOUND_QUEUE_SIZE) {
+			sound_insert_pos = 0;
+		}
+		if(!sound_playing) {
+			start_next_sound();
+		}
+	}
+	if(interrupts_were_on) {
+		sei();
+	}
+}
+
+/* Take the next sound off the queue and start the timer for it, or stop
+ * the timer if there are no sounds waiting. Must be called with
+ * interrupts disabled.
+ */
+static void start_next_sound(void) {
+	if(sounds_in_queue == 0) {
+		TCCR2B = 0;
+		PORTD &= ~(1<<SPEAKER_PIN);
+		sound_playing = 0;
+		return;
+	}
+	
+	uint8_t sound;
+	if(sound_insert_pos < sounds_in_queue) {
+		/* Need to wrap around */
+		sound = sound_queue[sound_insert_pos - sounds_in_queue 
+				+ SOUND_QUEUE_SIZE];
+	} else {
+		sound = sound_queue[sound_insert_pos - sounds_in_queue];
+	}
+	sounds_in_queue--;
+	
+	toggles_remaining = notes[sound].toggles;
+	OCR2A = notes[sound].half_period - 1;
+	TCNT2 = 0;
+	// Divide the clock by 128 - this starts the timer running
+	TCCR2B = (1<<CS22)|(1<<CS20);
+	sound_playing = 1;
+}
+
+/* Interrupt handler which fires every half period of the sound being
+ * played. The buzzer pin is only toggled if the mute switch is off, so
+ * muting takes effect immediately.
+ */
+ISR(TIMER2_COMPA_vect) {
+	if(toggles_remaining > 0) {
+		if(PIND & (1<<MUTE_PIN)) {
+			PORTD ^= (1<<SPEAKER_PIN);
+		}
+		toggles_remaining--;
+	} else {
+		start_next_sound();
+	}
+}
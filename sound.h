@@ -0,0 +1,27 @@
+/*
+ * sound.h
+ *
+ * Author: Max Bo
+ *
+ * Sound effects are played on a piezo buzzer connected to pin D7. A switch
+ * on pin D6 mutes the sound (sound is played only when D6 is high). Sounds
+ * are queued and played by a timer 2 interrupt handler, so the functions
+ * below return immediately. Interrupts must be enabled globally for sounds
+ * to be played.
+ */
+
+#ifndef SOUND_H_
+#define SOUND_H_
+
+/* Set up the buzzer and mute pins and timer 2. 
+ */
+void init_sound(void);
+
+/* Queue a sound to be played after any sounds already queued. If the
+ * queue is full the sound is discarded.
+ */
+void make_sound_high(void);
+void make_sound_medium(void);
+void make_sound_low(void);
+
+#endif /* SOUND_H_ */
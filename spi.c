@@ -5,8 +5,26 @@
  */ 
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include "spi.h"
 
+/* Circular buffer to hold outgoing bytes. This works on the same
+ * principle as the serial output buffer (see serialio.c). spi_insert_pos
+ * is the position that the next queued byte will be written to and
+ * bytes_in_spi_buffer is the number of bytes waiting to be sent (these
+ * are the bytes immediately prior to spi_insert_pos). spi_transfer_active
+ * is non-zero while a byte is being shifted out - the transfer complete
+ * interrupt handler then starts the next byte (if any).
+ * NOTE - SPI_BUFFER_SIZE can not be larger than 255 without changing
+ * the type of the variables below. The buffer is big enough to hold a
+ * complete LED matrix update.
+ */
+#define SPI_BUFFER_SIZE 192
+static volatile uint8_t spi_buffer[SPI_BUFFER_SIZE];
+static volatile uint8_t spi_insert_pos;
+static volatile uint8_t bytes_in_spi_buffer;
+static volatile uint8_t spi_transfer_active;
+
 void spi_setup_master(uint8_t clockdivider) {
 	// Set up SPI communication as a master
 	// Make the SS, MOSI and SCK pins outputs. These are pins
@@ -54,20 +72,92 @@ void spi_setup_master(uint8_t clockdivider) {
 			break;
 	}
 	
+	// Initialise our output queue
+	spi_insert_pos = 0;
+	bytes_in_spi_buffer = 0;
+	spi_transfer_active = 0;
+	
+	// Enable the SPI transfer complete interrupt. Note that interrupts
+	// have to be enabled globally before queued bytes will be sent.
+	SPCR0 |= (1<<SPIE0);
+	
 	// Take SS (slave select) line low
 	PORTB &= ~(1<<4);
 }
 
-uint8_t spi_send_byte(uint8_t byte) {
-	// Write out the byte to the SPDR register. This will initiate
-	// the transfer. We then wait until the most significant byte of
-	// SPSR (SPIF bit) is set - this indicates that the transfer is
-	// complete. (The final read of SPSR followed by a read of SPDR
-	// will cause the SPIF bit to be reset to 0. See page 173 of the 
-	// ATmega324A datasheet.)
-	SPDR0 = byte;
-	while((SPSR0 & (1<<SPIF0)) == 0) {
-		; // wait
+void spi_queue_byte(uint8_t byte) {
+	uint8_t interrupts_enabled;
+	
+	/* If the buffer is full and interrupts are disabled then we
+	 * discard the byte - the buffer will never be emptied if interrupts
+	 * are disabled. If the buffer is full and interrupts are enabled then
+	 * we wait until the interrupt handler has made space.
+	 */
+	interrupts_enabled = bit_is_set(SREG, SREG_I);
+	while(bytes_in_spi_buffer >= SPI_BUFFER_SIZE) {
+		if(!interrupts_enabled) {
+			return;
+		}
+		/* else do nothing */
+	}
+	
+	/* Disable interrupts while we modify the buffer so that the 
+	 * interrupt handler doesn't modify it at the same time. If no
+	 * transfer is in progress we start one straight away, otherwise we
+	 * add the byte to the buffer and the interrupt handler will send it
+	 * when the current transfer is complete.
+	 */
+	cli();
+	if(!spi_transfer_active) {
+		spi_transfer_active = 1;
+		SPDR0 = byte;
+	} else {
+		spi_buffer[spi_insert_pos++] = byte;
+		bytes_in_spi_buffer++;
+		if(spi_insert_pos == SPI_BUFFER_SIZE) {
+			/* Wrap around buffer pointer if necessary */
+			spi_insert_pos = 0;
+		}
+	}
+	if(interrupts_enabled) {
+		sei();
+	}
+}
+
+void spi_flush(void) {
+	/* Wait until the interrupt handler has sent everything. (If 
+	 * interrupts are disabled we can't wait - the queue would never empty.)
+	 */
+	if(bit_is_set(SREG, SREG_I)) {
+		while(spi_transfer_active) {
+			; // wait
+		}
+	}
+}
+
+/*
+ * Interrupt handler for SPI serial transfer complete. The SPIF flag is
+ * cleared by hardware when this handler runs. If there are more bytes 
+ * in the buffer we start sending the next one, otherwise we record that
+ * the SPI is idle.
+ */
+ISR(SPI_STC_vect) {
+	if(bytes_in_spi_buffer > 0) {
+		/* The pending byte is the one which is bytes_in_spi_buffer
+		 * bytes before the insert position (taking into account that
+		 * we may need to wrap around).
+		 */
+		uint8_t byte;
+		if(spi_insert_pos < bytes_in_spi_buffer) {
+			/* Need to wrap around */
+			byte = spi_buffer[spi_insert_pos - bytes_in_spi_buffer 
+					+ SPI_BUFFER_SIZE];
+		} else {
+			byte = spi_buffer[spi_insert_pos - bytes_in_spi_buffer];
+		}
+		bytes_in_spi_buffer--;
+		SPDR0 = byte;
+	} else {
+		spi_transfer_active = 0;
 	}
-	return SPDR0;
 }
\ No newline at end of file
@@ -2,17 +2,28 @@
  * spi.h
  *
  * Author: Peter Sutton
+ *
+ * SPI output is queued (spi_queue_byte()). Queued bytes are held in a 
+ * circular buffer and output by the SPI transfer complete interrupt 
+ * handler as fast as the SPI clock permits. Interrupts must be enabled 
+ * globally for queued output to be sent.
  */ 
 
 #ifndef SPI_H_
 #define SPI_H_
 
+#include <stdint.h>
+
 // Set up SPI communication as a master.
 // clockdivider should be one of 2,4,8,16,32,64,128
 void spi_setup_master(uint8_t clockdivider);
 
-// Send and receive an SPI byte. This function will take at least 8 
-// cyles of the divided clock
-uint8_t spi_send_byte(uint8_t byte);
+// Add a byte to the SPI output queue and return immediately (unless the
+// queue is full, in which case we wait for space). Bytes are sent in the
+// order they are queued.
+void spi_queue_byte(uint8_t byte);
+
+// Wait until all queued bytes have been sent.
+void spi_flush(void);
 
-#endif /* SPI_H_ */
\ No newline at end of file
+#endif /* SPI_H_ */
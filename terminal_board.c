@@ -0,0 +1,256 @@
+/*
+ * terminal_board.c
+ *
+ * Author: Max Bo
+ *
+ * Each square on the terminal is a space character. Coloured squares
+ * are drawn with the background colour set, black squares in the normal
+ * display mode, so each colour is a single display attribute. When 
+ * updating a row we
+ * - skip cells that already show the right colour,
+ * - only change the display attributes when the colour changes, and
+ * - only move the cursor when it isn't already in place (short gaps of
+ *   cells in the current colour are reprinted instead as that is cheaper
+ *   than a cursor movement). A cursor movement and a colour change are
+ *   sent together with the square in a single write.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <avr/pgmspace.h>
+
+#include "terminal_board.h"
+#include "terminalio.h"
+#include "serialio.h"
+#include "game.h"
+#include "blocks.h"
+#include "score.h"
+
+/* Value stored for a cell when we don't know what the terminal is
+ * showing. This is not a valid colour so the cell will always be redrawn.
+ */
+#define CELL_UNKNOWN 0x01
+
+/* Number of characters sent by move_cursor() on the board area. Gaps of
+ * fewer cells than this are reprinted rather than moving the cursor.
+ */
+#define MOVE_CURSOR_CHARS 8
+
+/* Number of characters sent to change the display attributes, and the
+ * most that can be sent to update a row (each cell moving the cursor and
+ * changing colour, then changing back to black).
+ */
+#define ATTRIBUTE_CHARS 5
+#define ROW_MAX_CHARS (BOARD_WIDTH * (MOVE_CURSOR_CHARS + ATTRIBUTE_CHARS + 1)\
+		+ ATTRIBUTE_CHARS)
+
+/* Most characters sent to update the score and cleared rows (each a 
+ * cursor movement and a line of text), and one row of the block preview 
+ * (a cursor movement and PREVIEW_SIZE squares)
+ */
+#define STATUS_MAX_CHARS (2 * (MOVE_CURSOR_CHARS + 24))
+#define PREVIEW_SIZE 3
+#define PREVIEW_ROW_MAX_CHARS (MOVE_CURSOR_CHARS + \
+		PREVIEW_SIZE * (2 * ATTRIBUTE_CHARS + 1))
+
+/* What each cell of the board area of the terminal is showing, indexed
+ * the same way as the board display (board row, then cell from the left).
+ */
+static PixelColour terminal_cells[BOARD_ROWS][BOARD_WIDTH];
+
+/* Rows which have changed but not been sent (bit n set for row n) */
+static uint16_t changed_rows;
+
+/* Whether the score has changed, and the preview rows which have changed
+ * (bit n set for row n), but not been sent
+ */
+static uint8_t score_changed;
+static uint8_t changed_preview_rows;
+
+static void terminal_update_column(uint8_t x, MatrixColumn col);
+static void terminal_draw_score(void);
+static void terminal_draw_preview_row(uint8_t row);
+static DisplayParameter terminal_colour(PixelColour pixel_colour);
+static void change_colour(PixelColour from, PixelColour to);
+
+void terminal_board_reset(void) {
+	for(uint8_t row = 0; row < BOARD_ROWS; row++) {
+		for(uint8_t cell = 0; cell < BOARD_WIDTH; cell++) {
+			terminal_cells[row][cell] = CELL_UNKNOWN;
+		}
+	}
+	terminal_mark_score();
+	terminal_mark_preview();
+}
+
+void terminal_mark_rows(uint8_t row_start, uint8_t num_rows) {
+	for(uint8_t row = row_start; row < row_start + num_rows && 
+			row < BOARD_ROWS; row++) {
+		changed_rows |= ((uint16_t)1 << row);
+	}
+}
+
+void terminal_mark_score(void) {
+	score_changed = 1;
+}
+
+void terminal_mark_preview(void) {
+	changed_preview_rows = (1 << PREVIEW_SIZE) - 1;
+}
+
+uint8_t terminal_board_flush(void) {
+	MatrixColumn col;
+	for(uint8_t row = 0; changed_rows != 0; row++) {
+		uint16_t row_bit = ((uint16_t)1 << row);
+		if(!(changed_rows & row_bit)) {
+			continue;
+		}
+		if(serial_output_space() < ROW_MAX_CHARS) {
+			// No room - try again later
+			return 0;
+		}
+		get_display_row(row, col);
+		terminal_update_column(row, col);
+		changed_rows &= ~row_bit;
+	}
+	
+	if(score_changed) {
+		if(serial_output_space() < STATUS_MAX_CHARS) {
+			return 0;
+		}
+		terminal_draw_score();
+		score_changed = 0;
+	}
+	
+	for(uint8_t row = 0; changed_preview_rows != 0; row++) {
+		uint8_t row_bit = (1 << row);
+		if(!(changed_preview_rows & row_bit)) {
+			continue;
+		}
+		if(serial_output_space() < PREVIEW_ROW_MAX_CHARS) {
+			return 0;
+		}
+		terminal_draw_preview_row(row);
+		changed_preview_rows &= ~row_bit;
+	}
+	return 1;
+}
+
+/*
+ * Update board row x on the terminal to show the given colours (element 0
+ * is on the left). Only cells which differ from what is already shown are
+ * output.
+ */
+static void terminal_update_column(uint8_t x, MatrixColumn col) {
+	PixelColour* shown = terminal_cells[x];
+	
+	// The colour we're currently drawing in. We start (and finish) in
+	// the normal display mode, i.e. black.
+	PixelColour current_colour = COLOUR_BLACK;
+	
+	// Cell the cursor is in front of, or BOARD_WIDTH if we don't know
+	// (we haven't output anything yet)
+	uint8_t cursor_cell = BOARD_WIDTH;
+	
+	for(uint8_t cell = 0; cell < MATRIX_NUM_ROWS; cell++) {
+		if(shown[cell] == col[cell]) {
+			continue;	// Already shown
+		}
+		
+		if(cursor_cell != cell) {
+			// Work out whether we can reach this cell by reprinting the
+			// cells in between (all in the current colour) more cheaply
+			// than moving the cursor.
+			uint8_t reprint = (cursor_cell < cell && 
+					cell - cursor_cell < MOVE_CURSOR_CHARS);
+			for(uint8_t i = cursor_cell; reprint && i < cell; i++) {
+				if(shown[i] != current_colour) {
+					reprint = 0;
+				}
+			}
+			if(reprint) {
+				for(; cursor_cell < cell; cursor_cell++) {
+					putchar(' ');
+				}
+			} else if(current_colour != col[cell]) {
+				draw_character(TERMINAL_BOARD_X + cell, TERMINAL_BOARD_Y + x,
+						terminal_colour(col[cell]), ' ');
+				current_colour = col[cell];
+				shown[cell] = col[cell];
+				cursor_cell = cell + 1;
+				continue;
+			} else {
+				move_cursor(TERMINAL_BOARD_X + cell, TERMINAL_BOARD_Y + x);
+			}
+		}
+		
+		change_colour(current_colour, col[cell]);
+		current_colour = col[cell];
+		putchar(' ');
+		shown[cell] = col[cell];
+		cursor_cell = cell + 1;
+	}
+	
+	change_colour(current_colour, COLOUR_BLACK);
+}
+
+/*
+ * Draw the score and number of cleared rows.
+ */
+static void terminal_draw_score(void) {
+	move_cursor(TERMINAL_SCORE_X, TERMINAL_SCORE_Y);
+	printf_P(PSTR("Score: %6d"), get_score());
+	move_cursor(TERMINAL_CLEARED_ROWS_X, TERMINAL_CLEARED_ROWS_Y);
+	printf_P(PSTR("Cleared rows: %6d"), get_cleared_rows());
+}
+
+/*
+ * Draw the given row of the preview of the next block. Rows below the 
+ * bottom of the block are drawn black.
+ */
+static void terminal_draw_preview_row(uint8_t row) {
+	const FallingBlock* block = get_next_block();
+	uint8_t pattern = (row < block->height) ? block->pattern[row] : 0;
+	move_cursor(TERMINAL_PREVIEW_X, TERMINAL_PREVIEW_Y + row);
+	for(uint8_t i = 0; i < PREVIEW_SIZE; i++) {
+		// The least significant bit of the pattern is on the right
+		if(pattern & (1 << (PREVIEW_SIZE - 1 - i))) {
+			print_square(block->colour);
+		} else {
+			print_square(COLOUR_BLACK);
+		}
+	}
+}
+
+void print_square(PixelColour pixel_colour) {
+	change_colour(COLOUR_BLACK, pixel_colour);
+	putchar(' ');
+	change_colour(pixel_colour, COLOUR_BLACK);
+}
+
+/*
+ * Return the display attribute used to display the given LED matrix 
+ * colour (a background colour, or the normal display mode for black).
+ */
+static DisplayParameter terminal_colour(PixelColour pixel_colour) {
+	switch(pixel_colour) {
+		case COLOUR_BLACK: return TERM_RESET;
+		case COLOUR_GREEN: return BG_GREEN;
+		case COLOUR_YELLOW: return BG_YELLOW;
+		case COLOUR_ORANGE: return BG_BLUE;
+		case COLOUR_LIGHT_ORANGE: return BG_CYAN;
+		default: return BG_RED;
+	}
+}
+
+/*
+ * Change the terminal display attributes from those used for the "from"
+ * colour to those used for the "to" colour. Nothing is output if the
+ * colours are the same.
+ */
+static void change_colour(PixelColour from, PixelColour to) {
+	if(from != to) {
+		set_display_attribute(terminal_colour(to));
+	}
+}
@@ -0,0 +1,71 @@
+/*
+ * terminal_board.h
+ *
+ * Author: Max Bo
+ *
+ * Display of the game board on the serial terminal. We remember what 
+ * each cell of the board area on the terminal is showing, so that only 
+ * cells which change need to be sent. 
+ * Changed rows are only marked when the game changes them and are sent
+ * by terminal_board_flush() when there is room in the serial output 
+ * buffer, so the game never waits for the terminal. A row which changes
+ * several times before it is sent is only sent once, as it is then.
+ * The score, number of cleared rows and the preview of the next block 
+ * are drawn the same way.
+ */
+
+#ifndef TERMINAL_BOARD_H_
+#define TERMINAL_BOARD_H_
+
+#include <stdint.h>
+#include "ledmatrix.h"
+
+/* Terminal position (column, row) of the top left of the board. Each row
+ * of the board is displayed on one row of the terminal.
+ */
+#define TERMINAL_BOARD_X 30
+#define TERMINAL_BOARD_Y 5
+
+/* Terminal positions of the score, number of cleared rows and the top
+ * left of the next block preview
+ */
+#define TERMINAL_SCORE_X 3
+#define TERMINAL_SCORE_Y 3
+#define TERMINAL_CLEARED_ROWS_X 3
+#define TERMINAL_CLEARED_ROWS_Y 6
+#define TERMINAL_PREVIEW_X 15
+#define TERMINAL_PREVIEW_Y 15
+
+/* Forget what the board area of the terminal is showing. Must be called
+ * after the terminal is cleared (or otherwise written over) so that the
+ * next update of each row redraws it completely. The score, cleared rows
+ * and preview are marked as changed.
+ */
+void terminal_board_reset(void);
+
+/* Mark num_rows board rows starting at row_start as changed.
+ */
+void terminal_mark_rows(uint8_t row_start, uint8_t num_rows);
+
+/* Mark the score and number of cleared rows (see score.h) as changed.
+ */
+void terminal_mark_score(void);
+
+/* Mark the preview of the next block (see get_next_block()) as changed.
+ */
+void terminal_mark_preview(void);
+
+/* Send the changed rows (as the game currently displays them - see 
+ * get_display_row()), then the score and preview if they have changed, 
+ * to the terminal, as long as there is room for each one in the serial
+ * output buffer. Returns 1 if everything has been sent, 0 if some is 
+ * still waiting.
+ */
+uint8_t terminal_board_flush(void);
+
+/* Print a single square of the given colour at the current cursor 
+ * position.
+ */
+void print_square(PixelColour pixel_colour);
+
+#endif /* TERMINAL_BOARD_H_ */
@@ -2,6 +2,10 @@
  * terminalio.c
  *
  * Author: Peter Sutton
+ *
+ * Escape sequences are built in a small buffer and sent with a single
+ * serial_write() rather than with printf_P, which has to parse the 
+ * format string each time.
  */
 
 #include <stdio.h>
@@ -10,54 +14,80 @@
 #include <avr/pgmspace.h>
 
 #include "terminalio.h"
+#include "serialio.h"
+
+#define ESCAPE_CHAR '\x1b'
 
+static char* put_csi(char* p);
+static char* put_number(char* p, uint8_t value);
+static char* put_cursor_position(char* p, int8_t x, int8_t y);
+static char* put_attribute(char* p, DisplayParameter parameter);
+static void write_sequence_P(const char* sequence);
 
 void move_cursor(int8_t x, int8_t y) {
-    printf_P(PSTR("\x1b[%d;%dH"), y, x);
+	char buffer[10];
+	char* end = put_cursor_position(buffer, x, y);
+	serial_write(buffer, end - buffer);
 }
 
 void normal_display_mode(void) {
-	printf_P(PSTR("\x1b[0m"));
+	write_sequence_P(PSTR("\x1b[0m"));
 }
 
 void reverse_video(void) {
-	printf_P(PSTR("\x1b[7m"));
+	write_sequence_P(PSTR("\x1b[7m"));
 }
 
 void clear_terminal(void) {
-	printf_P(PSTR("\x1b[2J"));
+	write_sequence_P(PSTR("\x1b[2J"));
 }
 
 void clear_to_end_of_line(void) {
-	printf_P(PSTR("\x1b[K"));
+	write_sequence_P(PSTR("\x1b[K"));
 }
 
 void set_display_attribute(DisplayParameter parameter) {
-	printf_P(PSTR("\x1b[%dm"), parameter);
+	char buffer[6];
+	char* end = put_attribute(buffer, parameter);
+	serial_write(buffer, end - buffer);
+}
+
+void draw_character(int8_t x, int8_t y, DisplayParameter parameter, char c) {
+	char buffer[17];
+	char* end = put_cursor_position(buffer, x, y);
+	end = put_attribute(end, parameter);
+	*end++ = c;
+	serial_write(buffer, end - buffer);
 }
 
 void hide_cursor() {
-	printf_P(PSTR("\x1b[?25l"));
+	write_sequence_P(PSTR("\x1b[?25l"));
 }
 
 void show_cursor() {
-	printf_P(PSTR("\x1b[?25h"));
+	write_sequence_P(PSTR("\x1b[?25h"));
 }
 
 void enable_scrolling_for_whole_display(void) {
-	printf_P(PSTR("\x1b[r"));
+	write_sequence_P(PSTR("\x1b[r"));
 }
 
 void set_scroll_region(int8_t y1, int8_t y2) {
-	printf_P(PSTR("\x1b[%d;%dr"), y1, y2);
+	char buffer[10];
+	char* end = put_csi(buffer);
+	end = put_number(end, y1);
+	*end++ = ';';
+	end = put_number(end, y2);
+	*end++ = 'r';
+	serial_write(buffer, end - buffer);
 }
 
 void scroll_down(void) {
-	printf_P(PSTR("\x1bM"));	// ESC-M
+	write_sequence_P(PSTR("\x1bM"));	// ESC-M
 }
 
 void scroll_up(void) {
-	printf_P(PSTR("\x1b\x44"));	// ESC-D
+	write_sequence_P(PSTR("\x1b\x44"));	// ESC-D
 }
 
 void draw_horizontal_line(int8_t y, int8_t start_x, int8_t end_x) {
@@ -65,10 +95,7 @@ void draw_horizontal_line(int8_t y, int8_t start_x, int8_t end_x) {
 	move_cursor(start_x, y);
 	reverse_video();
 	for(i=start_x; i <= end_x; i++) {
-		printf(" ");	/* No need to use printf_P - printing 
-						 * a single character gets optimised
-						 * to a putchar call 
-						 */
+		putchar(' ');
 	}
 	normal_display_mode();
 }
@@ -78,10 +105,59 @@ void draw_vertical_line(int8_t x, int8_t start_y, int8_t end_y) {
 	move_cursor(x, start_y);
 	reverse_video();
 	for(i=start_y; i < end_y; i++) {
-		printf(" ");
-		/* Move down one and back to the left one */
-		printf_P(PSTR("\x1b[B\x1b[D"));
+		/* Print a space then move down one and back to the left one */
+		write_sequence_P(PSTR(" \x1b[B\x1b[D"));
 	}
-	printf(" ");
+	putchar(' ');
 	normal_display_mode();
-}
\ No newline at end of file
+}
+
+/*
+ * The put functions below write part of an escape sequence to the buffer
+ * at p and return a pointer to the character after it.
+ */
+
+/* Control sequence introducer: ESC [ */
+static char* put_csi(char* p) {
+	*p++ = ESCAPE_CHAR;
+	*p++ = '[';
+	return p;
+}
+
+/* Decimal number (without leading zeros) */
+static char* put_number(char* p, uint8_t value) {
+	if(value >= 100) {
+		*p++ = '0' + value / 100;
+		value %= 100;
+		*p++ = '0' + value / 10;
+	} else if(value >= 10) {
+		*p++ = '0' + value / 10;
+	}
+	*p++ = '0' + value % 10;
+	return p;
+}
+
+/* ESC [ y ; x H */
+static char* put_cursor_position(char* p, int8_t x, int8_t y) {
+	p = put_csi(p);
+	p = put_number(p, y);
+	*p++ = ';';
+	p = put_number(p, x);
+	*p++ = 'H';
+	return p;
+}
+
+/* ESC [ parameter m */
+static char* put_attribute(char* p, DisplayParameter parameter) {
+	p = put_csi(p);
+	p = put_number(p, parameter);
+	*p++ = 'm';
+	return p;
+}
+
+/*
+ * Write a fixed sequence from program memory.
+ */
+static void write_sequence_P(const char* sequence) {
+	serial_write_P(sequence, strlen_P(sequence));
+}
@@ -60,6 +60,11 @@ void reverse_video(void);
 void clear_terminal(void);
 void clear_to_end_of_line(void);
 void set_display_attribute(DisplayParameter parameter);
+
+// Move the cursor to (x,y), set the given display attribute and print 
+// character c there - all in one write.
+void draw_character(int8_t x, int8_t y, DisplayParameter parameter, char c);
+
 void hide_cursor(void);
 void show_cursor(void);
 
@@ -6,17 +6,48 @@
  * We setup timer0 to generate an interrupt every 1ms
  * We update a global clock tick variable - whose value
  * can be retrieved using the get_clock_ticks() function.
+ * The tasks run by run_due_tasks() are scheduled using
+ * this clock. Idle time is measured in timer counts (8us)
+ * using the clock tick and the timer 0 counter value.
  */
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
 
 #include "timer0.h"
+#include "buttons.h"
+#include "seven_seg.h"
 
 /* Our internal clock tick count - incremented every 
  * millisecond. Will overflow every ~49 days. */
 static volatile uint32_t clock_ticks;
 
+/* Task table. Unused entries have a null function. The deadline
+ * is the clock tick value at which the task is next due (or
+ * the time it has left if it is suspended).
+ */
+typedef struct {
+	TaskFunction function;
+	uint16_t period;
+	uint8_t suspended;
+	uint32_t deadline;
+} Task;
+
+static Task tasks[MAX_TASKS];
+
+/* Clock tick value when run_due_tasks() last checked the tasks */
+static uint32_t task_time;
+
+/* Timer counts in a clock tick (the timer counts from 0 to 124) */
+#define COUNTS_PER_TICK 125
+
+/* Time spent asleep (in timer counts) since idle_start_time */
+static uint32_t idle_counts;
+static uint32_t idle_start_time;
+
+static uint8_t task_due(uint32_t now);
+
 /* Set up timer 0 to generate an interrupt every 1ms. 
  * We will divide the clock by 64 and count up to 124.
  * We will therefore get an interrupt every 64 x 125
@@ -59,18 +90,157 @@ void init_timer0(void) {
 uint32_t get_clock_ticks(void) {
 	uint32_t return_value;
 
-	/* Disable interrupts so we can be sure that the interrupt
-	 * doesn't fire when we've copied just a couple of bytes
-	 * of the value. Interrupts are re-enabled if they were
-	 * enabled at the start.
+	/* The interrupt could fire when we've copied just a couple 
+	 * of bytes of the value, so we read it until we get the 
+	 * same value twice in a row. The value only changes once a
+	 * millisecond so this will almost never take more than 
+	 * two reads - and we don't have to disable interrupts.
+	 */
+	do {
+		return_value = clock_ticks;
+	} while(return_value != clock_ticks);
+	return return_value;
+}
+
+int8_t add_task(uint16_t period, TaskFunction function) {
+	for(int8_t i = 0; i < MAX_TASKS; i++) {
+		if(!tasks[i].function) {
+			tasks[i].function = function;
+			tasks[i].period = period;
+			tasks[i].suspended = 0;
+			tasks[i].deadline = get_clock_ticks() + period;
+			return i;
+		}
+	}
+	return -1;
+}
+
+void clear_tasks(void) {
+	for(uint8_t i = 0; i < MAX_TASKS; i++) {
+		tasks[i].function = 0;
+	}
+}
+
+void set_task_period(int8_t task, uint16_t period) {
+	tasks[task].deadline += period - tasks[task].period;
+	tasks[task].period = period;
+}
+
+void restart_task(int8_t task) {
+	if(tasks[task].suspended) {
+		tasks[task].deadline = tasks[task].period;
+	} else {
+		tasks[task].deadline = get_clock_ticks() + tasks[task].period;
+	}
+}
+
+void suspend_task(int8_t task) {
+	if(!tasks[task].suspended) {
+		tasks[task].deadline -= get_clock_ticks();
+		tasks[task].suspended = 1;
+	}
+}
+
+void resume_task(int8_t task) {
+	if(tasks[task].suspended) {
+		tasks[task].deadline += get_clock_ticks();
+		tasks[task].suspended = 0;
+	}
+}
+
+uint8_t run_due_tasks(void) {
+	uint8_t tasks_run = 0;
+	
+	/* The time is read once and used for all the tasks (which
+	 * can get it with get_task_time())
+	 */
+	uint32_t now = get_clock_ticks();
+	task_time = now;
+	for(uint8_t i = 0; i < MAX_TASKS; i++) {
+		if(tasks[i].function && !tasks[i].suspended &&
+				(int32_t)(now - tasks[i].deadline) >= 0) {
+			/* Schedule the next run before running the task so
+			 * that the task can restart itself or change its period
+			 */
+			tasks[i].deadline = now + tasks[i].period;
+			tasks[i].function();
+			tasks_run++;
+		}
+	}
+	return tasks_run;
+}
+
+uint32_t get_task_time(void) {
+	return task_time;
+}
+
+/* Return true if any task is due at the given time */
+static uint8_t task_due(uint32_t now) {
+	for(uint8_t i = 0; i < MAX_TASKS; i++) {
+		if(tasks[i].function && !tasks[i].suspended &&
+				(int32_t)(now - tasks[i].deadline) >= 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void sleep_until_task_due(void) {
+	uint32_t start_ticks, end_ticks;
+	uint8_t start_count, end_count;
+	
+	/* Interrupts are disabled while we check whether to sleep - 
+	 * otherwise an interrupt could make a task due after we've 
+	 * checked and we'd sleep anyway. We also don't sleep if the tick
+	 * interrupt is pending, as the clock tick value is out of date. 
+	 * Interrupts are re-enabled by sei just before sleeping - the
+	 * instruction after sei is always executed before any pending 
+	 * interrupt is handled, so an interrupt can't be missed.
 	 */
-	uint8_t interrupts_were_on = bit_is_set(SREG, SREG_I);
 	cli();
-	return_value = clock_ticks;
-	if(interrupts_were_on) {
+	start_ticks = clock_ticks;
+	start_count = TCNT0;
+	if((TIFR0 & (1<<OCF0A)) || task_due(start_ticks)) {
 		sei();
+		return;
 	}
-	return return_value;
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_enable();
+	sei();
+	sleep_cpu();
+	sleep_disable();
+	
+	/* The interrupt that woke us has been handled. If the counter 
+	 * has just wrapped around but the tick interrupt hasn't been 
+	 * handled yet, count the tick ourselves.
+	 */
+	cli();
+	end_ticks = clock_ticks;
+	end_count = TCNT0;
+	if((TIFR0 & (1<<OCF0A)) && end_count < COUNTS_PER_TICK / 2) {
+		end_ticks++;
+	}
+	sei();
+	idle_counts += (end_ticks - start_ticks) * COUNTS_PER_TICK + 
+			end_count - start_count;
+}
+
+void reset_idle_time(void) {
+	idle_counts = 0;
+	idle_start_time = get_clock_ticks();
+}
+
+uint8_t get_idle_percentage(void) {
+	uint32_t elapsed = get_clock_ticks() - idle_start_time;
+	if(elapsed == 0) {
+		return 0;
+	}
+	/* Idle time in ticks (ms) as a percentage of the elapsed time */
+	uint32_t percentage = (idle_counts / COUNTS_PER_TICK) * 100 / elapsed;
+	if(percentage > 100) {
+		percentage = 100;
+	}
+	return percentage;
 }
 
 /* Interrupt handler which fires when timer/counter 0 reaches 
@@ -79,4 +249,10 @@ uint32_t get_clock_ticks(void) {
 ISR(TIMER0_COMPA_vect) {
 	/* Increment our clock tick count */
 	clock_ticks++;
+	
+	/* Debounce the buttons */
+	sample_buttons();
+	
+	/* Display the other seven segment digit */
+	refresh_seven_seg();
 }
@@ -31,4 +31,63 @@ void init_timer0(void);
  */
 uint32_t get_clock_ticks(void);
 
+/* Tasks are functions that are run regularly from the main loop (not
+ * from the interrupt handler) by calling run_due_tasks(). Each task has a
+ * period in milliseconds and is run when that long has passed since it 
+ * last ran (or since it was added or restarted). Tasks run to completion
+ * and must not block.
+ */
+#define MAX_TASKS 4
+
+typedef void (*TaskFunction)(void);
+
+/* Add a task that first runs period milliseconds from now. Returns the 
+ * task number, or -1 if the task table is full.
+ */
+int8_t add_task(uint16_t period, TaskFunction function);
+
+/* Remove all tasks.
+ */
+void clear_tasks(void);
+
+/* Change the period of a task. The change applies to the current period,
+ * i.e. the task will next run period milliseconds after it last ran.
+ */
+void set_task_period(int8_t task, uint16_t period);
+
+/* Make a task next run a full period from now.
+ */
+void restart_task(int8_t task);
+
+/* Stop running a task until it is resumed. When resumed the task runs
+ * after whatever was left of its period when it was suspended.
+ */
+void suspend_task(int8_t task);
+void resume_task(int8_t task);
+
+/* Run all tasks that are due. Returns the number of tasks run.
+ */
+uint8_t run_due_tasks(void);
+
+/* Return the clock tick value at which run_due_tasks() last checked the
+ * tasks. Tasks can use this instead of get_clock_ticks() as the time
+ * they were run.
+ */
+uint32_t get_task_time(void);
+
+/* Put the CPU to sleep (idle mode) if no task is due. The CPU is woken
+ * by the next interrupt - at the latest the next clock tick. Time spent
+ * asleep is added to the idle time.
+ */
+void sleep_until_task_due(void);
+
+/* Reset the idle time and start measuring from now.
+ */
+void reset_idle_time(void);
+
+/* Return the percentage of the time since reset_idle_time() was called
+ * that the CPU spent asleep.
+ */
+uint8_t get_idle_percentage(void);
+
 #endif
\ No newline at end of file